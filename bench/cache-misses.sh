@@ -0,0 +1,63 @@
+#!/bin/sh
+#
+# Count CPU cache misses per request of one or more wrk binaries with
+# perf stat, e.g. to compare builds before and after a layout change:
+#
+#   bench/cache-misses.sh http://10.0.0.2:8080/ ./wrk.before ./wrk
+#
+# By default every binary runs one thread with 100k connections, which
+# needs an open file limit above that on both ends and more local source
+# addresses than the ephemeral port range of one address allows. The
+# environment overrides the defaults:
+#
+#   CONNECTIONS  connections of the thread (100000)
+#   DURATION     duration of each run (30s)
+#   SOURCES      --source-ips of wrk (127.0.0.2-127.0.0.9), empty for
+#                builds without it
+#   ARGS         more wrk arguments, e.g. --latency
+#
+# The counters include connecting, so DURATION should be long enough for
+# the connect phase not to matter.
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <url> <wrk> [<wrk> ...]" >&2
+    exit 1
+fi
+
+url=$1
+shift
+
+connections=${CONNECTIONS:-100000}
+duration=${DURATION:-30s}
+sources=${SOURCES-127.0.0.2-127.0.0.9}
+events=cache-misses,L1-dcache-load-misses,LLC-load-misses,dTLB-load-misses
+
+ulimit -n $((connections + 1024))
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+printf '%-20s %10s %14s %14s %14s %14s\n' \
+    binary requests cache-misses L1d-misses LLC-misses dTLB-misses
+
+for wrk in "$@"; do
+    perf stat -x, -o "$tmp/perf" -e $events -- \
+        "$wrk" -t1 -c"$connections" -d"$duration" --timeout 10s \
+        ${sources:+--source-ips "$sources"} $ARGS "$url" > "$tmp/wrk"
+
+    requests=$(awk '/ requests in / { print $1 }' "$tmp/wrk")
+    printf '%-20s %10s' "$wrk" "$requests"
+    for event in $(echo $events | tr , ' '); do
+        awk -F, -v event="$event" -v requests="$requests" '
+            $3 == event {
+                if ($1 ~ /^[0-9]+$/ && requests > 0) {
+                    printf " %14.2f", $1 / requests
+                } else {
+                    printf " %14s", "n/a"
+                }
+            }' "$tmp/perf"
+    done
+    printf '\n'
+done
@@ -60,6 +60,73 @@
     #endif
 #endif
 
+/* Multiplexing layers that can be chosen at runtime with aeSetApi(). The
+ * first entry is the compiled in default above. */
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+/* Timeouts passed to io_uring_enter(2) need 5.11+ kernel headers, multishot
+ * receives into provided buffer rings 6.0+ ones. */
+#if !defined(IORING_FEAT_EXT_ARG) || !defined(IORING_RECV_MULTISHOT)
+#undef HAVE_IO_URING
+#endif
+#endif
+#ifdef HAVE_IO_URING
+#include "ae_io_uring.c"
+#endif
+
+typedef struct aeApi {
+    char *(*name)(void);
+    int (*create)(aeEventLoop *eventLoop);
+    int (*resize)(aeEventLoop *eventLoop, int setsize);
+    void (*free)(aeEventLoop *eventLoop);
+    int (*add)(aeEventLoop *eventLoop, int fd, int mask);
+    void (*del)(aeEventLoop *eventLoop, int fd, int delmask);
+    int (*poll)(aeEventLoop *eventLoop, struct timeval *tvp);
+    int edge; /* only reports changes in readiness */
+    /* Completion based I/O, NULL for layers that only report readiness. */
+    int (*buffers)(aeEventLoop *eventLoop, size_t size);
+    int (*recv)(aeEventLoop *eventLoop, int fd);
+    int (*send)(aeEventLoop *eventLoop, int fd, char *buf, size_t len);
+} aeApi;
+
+static const aeApi aeApis[] = {
+    { aeApiName, aeApiCreate, aeApiResize, aeApiFree,
+      aeApiAddEvent, aeApiDelEvent, aeApiPoll, 0 },
+#if !defined(HAVE_EVPORT) && defined(HAVE_EPOLL)
+    { aeApiNameEdge, aeApiCreateEdge, aeApiResize, aeApiFree,
+      aeApiAddEvent, aeApiDelEvent, aeApiPoll, 1 },
+#endif
+#ifdef HAVE_IO_URING
+    { aeUringName, aeUringCreate, aeUringResize, aeUringFree,
+      aeUringAddEvent, aeUringDelEvent, aeUringPoll, 0,
+      aeUringBuffers, aeUringRecv, aeUringSend },
+#endif
+    { NULL }
+};
+
+static const aeApi *aeApiDefault = &aeApis[0];
+
+/* Select the multiplexing layer used by event loops created from now on.
+ * Returns AE_ERR if no layer with that name is compiled in. */
+int aeSetApi(char *name) {
+    const aeApi *api;
+
+    for (api = aeApis; api->name; api++) {
+        if (!strcmp(api->name(), name)) {
+            aeApiDefault = api;
+            return AE_OK;
+        }
+    }
+    return AE_ERR;
+}
+
+static long long aeMonotonicMs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
 aeEventLoop *aeCreateEventLoop(int setsize) {
     aeEventLoop *eventLoop;
     int i;
@@ -69,13 +136,20 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
-    eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
-    eventLoop->timeEventNextId = 0;
+    eventLoop->timeEvents = NULL;
+    eventLoop->timeEventSize = 0;
+    eventLoop->timeEventFree = -1;
+    eventLoop->timeEventCount = 0;
+    eventLoop->timeNow = aeMonotonicMs();
+    for (i = 0; i < AE_WHEEL_BUCKETS; i++)
+        eventLoop->timeWheel[i] = -1;
+    for (i = 0; i < AE_WHEEL_LEVELS; i++)
+        eventLoop->timeWheelUsed[i] = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
     eventLoop->beforesleep = NULL;
-    if (aeApiCreate(eventLoop) == -1) goto err;
+    eventLoop->api = aeApiDefault;
+    if (eventLoop->api->create(eventLoop) == -1) goto err;
     /* Events with mask == AE_NONE are not set. So let's initialize the
      * vector with it. */
     for (i = 0; i < setsize; i++)
@@ -108,7 +182,7 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 
     if (setsize == eventLoop->setsize) return AE_OK;
     if (eventLoop->maxfd >= setsize) return AE_ERR;
-    if (aeApiResize(eventLoop,setsize) == -1) return AE_ERR;
+    if (eventLoop->api->resize(eventLoop,setsize) == -1) return AE_ERR;
 
     eventLoop->events = zrealloc(eventLoop->events,sizeof(aeFileEvent)*setsize);
     eventLoop->fired = zrealloc(eventLoop->fired,sizeof(aeFiredEvent)*setsize);
@@ -122,7 +196,8 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
-    aeApiFree(eventLoop);
+    eventLoop->api->free(eventLoop);
+    zfree(eventLoop->timeEvents);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
     zfree(eventLoop);
@@ -141,7 +216,7 @@ int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
     }
     aeFileEvent *fe = &eventLoop->events[fd];
 
-    if (aeApiAddEvent(eventLoop, fd, mask) == -1)
+    if (eventLoop->api->add(eventLoop, fd, mask) == -1)
         return AE_ERR;
     fe->mask |= mask;
     if (mask & AE_READABLE) fe->rfileProc = proc;
@@ -158,7 +233,7 @@ void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
     aeFileEvent *fe = &eventLoop->events[fd];
     if (fe->mask == AE_NONE) return;
 
-    aeApiDelEvent(eventLoop, fd, mask);
+    eventLoop->api->del(eventLoop, fd, mask);
     fe->mask = fe->mask & (~mask);
     if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
         /* Update the max fd */
@@ -170,6 +245,69 @@ void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
     }
 }
 
+/* Give the layer buffers of size bytes to receive into. Returns AE_ERR if
+ * it only reports readiness, aeCreateRecvEvent and aeSend then fail too. */
+int aeSetRecvBuffers(aeEventLoop *eventLoop, size_t size) {
+    if (!eventLoop->api->buffers) {
+        errno = ENOTSUP;
+        return AE_ERR;
+    }
+    return eventLoop->api->buffers(eventLoop, size) == -1 ? AE_ERR : AE_OK;
+}
+
+/* Receive continuously from fd, proc is called with every chunk of data,
+ * with 0 at end of file or a negative errno. */
+int aeCreateRecvEvent(aeEventLoop *eventLoop, int fd,
+        aeRecvProc *proc, void *clientData)
+{
+    if (fd >= eventLoop->setsize) {
+        errno = ERANGE;
+        return AE_ERR;
+    }
+    aeFileEvent *fe = &eventLoop->events[fd];
+
+    if (!(fe->mask & AE_RECV)) {
+        if (!eventLoop->api->recv) {
+            errno = ENOTSUP;
+            return AE_ERR;
+        }
+        if (eventLoop->api->recv(eventLoop, fd) == -1)
+            return AE_ERR;
+    }
+    fe->mask |= AE_RECV;
+    fe->recvProc = proc;
+    fe->clientData = clientData;
+    if (fd > eventLoop->maxfd)
+        eventLoop->maxfd = fd;
+    return AE_OK;
+}
+
+/* Send all len bytes of buf, which must stay valid until they are sent.
+ * proc is only called if that fails, with a negative errno or the number
+ * of bytes that were sent. */
+int aeSend(aeEventLoop *eventLoop, int fd, char *buf, size_t len,
+        aeSendProc *proc, void *clientData)
+{
+    if (fd >= eventLoop->setsize) {
+        errno = ERANGE;
+        return AE_ERR;
+    }
+    aeFileEvent *fe = &eventLoop->events[fd];
+
+    if (!eventLoop->api->send) {
+        errno = ENOTSUP;
+        return AE_ERR;
+    }
+    if (eventLoop->api->send(eventLoop, fd, buf, len) == -1)
+        return AE_ERR;
+    fe->mask |= AE_SEND;
+    fe->sendProc = proc;
+    fe->clientData = clientData;
+    if (fd > eventLoop->maxfd)
+        eventLoop->maxfd = fd;
+    return AE_OK;
+}
+
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
     if (fd >= eventLoop->setsize) return 0;
     aeFileEvent *fe = &eventLoop->events[fd];
@@ -177,158 +315,231 @@ int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
     return fe->mask;
 }
 
-static void aeGetTime(long *seconds, long *milliseconds)
-{
-    struct timeval tv;
+static void aeWheelLink(aeEventLoop *eventLoop, int idx, int bucket) {
+    aeTimeEvent *te = &eventLoop->timeEvents[idx];
+    int head = eventLoop->timeWheel[bucket];
+
+    te->bucket = bucket;
+    te->prev = -1;
+    te->next = head;
+    if (head != -1) eventLoop->timeEvents[head].prev = idx;
+    eventLoop->timeWheel[bucket] = idx;
+    if (bucket < AE_WHEEL_DUE)
+        eventLoop->timeWheelUsed[bucket/AE_WHEEL_SLOTS] |=
+            1ULL << (bucket%AE_WHEEL_SLOTS);
+}
 
-    gettimeofday(&tv, NULL);
-    *seconds = tv.tv_sec;
-    *milliseconds = tv.tv_usec/1000;
+static void aeWheelUnlink(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent *te = &eventLoop->timeEvents[idx];
+    int bucket = te->bucket;
+
+    if (te->prev != -1)
+        eventLoop->timeEvents[te->prev].next = te->next;
+    else
+        eventLoop->timeWheel[bucket] = te->next;
+    if (te->next != -1)
+        eventLoop->timeEvents[te->next].prev = te->prev;
+    if (bucket < AE_WHEEL_DUE && eventLoop->timeWheel[bucket] == -1)
+        eventLoop->timeWheelUsed[bucket/AE_WHEEL_SLOTS] &=
+            ~(1ULL << (bucket%AE_WHEEL_SLOTS));
+    te->bucket = -1;
 }
 
-static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-    long cur_sec, cur_ms, when_sec, when_ms;
+/* Put the event in the lowest level whose span around the current tick
+ * contains its expire time, so every event is found again by cascading
+ * before or on the tick it is due. */
+static void aeWheelInsert(aeEventLoop *eventLoop, int idx) {
+    long long when = eventLoop->timeEvents[idx].when;
+    long long now = eventLoop->timeNow;
+    int level, shift;
+
+    if (when <= now) {
+        aeWheelLink(eventLoop, idx, AE_WHEEL_DUE);
+        return;
+    }
+    for (level = 0; level < AE_WHEEL_LEVELS-1; level++) {
+        shift = AE_WHEEL_BITS*(level+1);
+        if ((when >> shift) == (now >> shift)) break;
+    }
+    if (level == AE_WHEEL_LEVELS-1) {
+        /* Clamp to the span of the top level, the event is inserted again
+         * with its real expire time when its slot is cascaded. */
+        long long max = now + (1LL << (AE_WHEEL_BITS*AE_WHEEL_LEVELS)) - 1;
+        if (when > max) when = max;
+    }
+    shift = AE_WHEEL_BITS*level;
+    aeWheelLink(eventLoop, idx, level*AE_WHEEL_SLOTS +
+            (int) ((when >> shift) & (AE_WHEEL_SLOTS-1)));
+}
+
+/* Move every event of a slot down to the levels below it. */
+static void aeWheelCascade(aeEventLoop *eventLoop, int bucket) {
+    int idx = eventLoop->timeWheel[bucket];
+
+    while (idx != -1) {
+        int next = eventLoop->timeEvents[idx].next;
+        aeWheelUnlink(eventLoop, idx);
+        aeWheelInsert(eventLoop, idx);
+        idx = next;
+    }
+}
+
+/* Advance the wheel tick by tick up to now, collecting expired events in
+ * the due bucket. */
+static void aeWheelAdvance(aeEventLoop *eventLoop, long long now) {
+    if (eventLoop->timeEventCount == 0) {
+        if (now > eventLoop->timeNow) eventLoop->timeNow = now;
+        return;
+    }
+    while (eventLoop->timeNow < now) {
+        long long tick = ++eventLoop->timeNow;
+        int level;
 
-    aeGetTime(&cur_sec, &cur_ms);
-    when_sec = cur_sec + milliseconds/1000;
-    when_ms = cur_ms + milliseconds%1000;
-    if (when_ms >= 1000) {
-        when_sec ++;
-        when_ms -= 1000;
+        for (level = 1; level < AE_WHEEL_LEVELS; level++) {
+            if (tick & ((1LL << (AE_WHEEL_BITS*level)) - 1)) break;
+        }
+        while (--level > 0) {
+            int slot = (tick >> (AE_WHEEL_BITS*level)) & (AE_WHEEL_SLOTS-1);
+            aeWheelCascade(eventLoop, level*AE_WHEEL_SLOTS + slot);
+        }
+        aeWheelCascade(eventLoop, (int) (tick & (AE_WHEEL_SLOTS-1)));
+    }
+}
+
+/* Milliseconds until the next time event may be due, or -1 if there are
+ * no time events. Events in higher levels are only known to be due at the
+ * start of their slot, which is when they are cascaded down. */
+static long long aeWheelTimeout(aeEventLoop *eventLoop) {
+    long long now = eventLoop->timeNow;
+    long long start, ms;
+    int level, shift;
+
+    if (eventLoop->timeEventCount == 0) return -1;
+    if (eventLoop->timeWheel[AE_WHEEL_DUE] != -1) return 0;
+
+    for (level = 0; level < AE_WHEEL_LEVELS; level++) {
+        int pos;
+        unsigned long long used = eventLoop->timeWheelUsed[level];
+
+        shift = AE_WHEEL_BITS*level;
+        pos = (now >> shift) & (AE_WHEEL_SLOTS-1);
+        used &= (~0ULL << pos) << 1;
+        if (used) {
+            start = ((now >> (shift+AE_WHEEL_BITS)) << (shift+AE_WHEEL_BITS)) |
+                ((long long) __builtin_ctzll(used) << shift);
+            break;
+        }
+    }
+    if (level == AE_WHEEL_LEVELS) {
+        /* Only events in top level slots behind the current one, which
+         * wrapped around: wake up on the next top level slot. */
+        shift = AE_WHEEL_BITS*(AE_WHEEL_LEVELS-1);
+        start = ((now >> shift) + 1) << shift;
     }
-    *sec = when_sec;
-    *ms = when_ms;
+    ms = start - aeMonotonicMs();
+    return ms > 0 ? ms : 0;
+}
+
+static void aeFreeTimeEvent(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent *te = &eventLoop->timeEvents[idx];
+    aeEventFinalizerProc *finalizerProc = te->finalizerProc;
+    void *clientData = te->clientData;
+
+    te->id = AE_DELETED_EVENT_ID;
+    te->gen++;
+    te->next = eventLoop->timeEventFree;
+    eventLoop->timeEventFree = idx;
+    eventLoop->timeEventCount--;
+    if (finalizerProc) finalizerProc(eventLoop, clientData);
 }
 
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
 {
-    long long id = eventLoop->timeEventNextId++;
     aeTimeEvent *te;
+    int idx;
+
+    if (eventLoop->timeEventFree == -1) {
+        int size = eventLoop->timeEventSize ? eventLoop->timeEventSize*2 : 64;
+        aeTimeEvent *events = zrealloc(eventLoop->timeEvents, sizeof(aeTimeEvent)*size);
+        int j;
+
+        if (events == NULL) return AE_ERR;
+        for (j = eventLoop->timeEventSize; j < size; j++) {
+            events[j].id = AE_DELETED_EVENT_ID;
+            events[j].gen = 0;
+            events[j].bucket = -1;
+            events[j].next = j+1 < size ? j+1 : -1;
+        }
+        eventLoop->timeEvents = events;
+        eventLoop->timeEventFree = eventLoop->timeEventSize;
+        eventLoop->timeEventSize = size;
+    }
 
-    te = zmalloc(sizeof(*te));
-    if (te == NULL) return AE_ERR;
-    te->id = id;
-    aeAddMillisecondsToNow(milliseconds,&te->when_sec,&te->when_ms);
+    idx = eventLoop->timeEventFree;
+    te = &eventLoop->timeEvents[idx];
+    eventLoop->timeEventFree = te->next;
+    eventLoop->timeEventCount++;
+
+    te->id = ((long long) (te->gen & 0x7fffffff) << 32) | idx;
+    te->when = aeMonotonicMs() + milliseconds;
     te->timeProc = proc;
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
-    return id;
+    aeWheelInsert(eventLoop, idx);
+    return te->id;
 }
 
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            te->id = AE_DELETED_EVENT_ID;
-            return AE_OK;
-        }
-        te = te->next;
-    }
-    return AE_ERR; /* NO event with the specified ID found */
-}
+    int idx = (int) (id & 0xffffffff);
+    aeTimeEvent *te;
 
-/* Search the first timer to fire.
- * This operation is useful to know how many time the select can be
- * put in sleep without to delay any event.
- * If there are no timers NULL is returned.
- *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
-static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
-{
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
+    if (id < 0 || idx >= eventLoop->timeEventSize) return AE_ERR;
+    te = &eventLoop->timeEvents[idx];
+    if (te->id != id) return AE_ERR; /* NO event with the specified ID found */
+
+    if (te->bucket == -1) {
+        /* Deleted by its own callback, freed once the callback returns. */
+        te->id = AE_DELETED_EVENT_ID;
+    } else {
+        aeWheelUnlink(eventLoop, idx);
+        aeFreeTimeEvent(eventLoop, idx);
     }
-    return nearest;
+    return AE_OK;
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
     int processed = 0;
-    aeTimeEvent *te, *prev;
-    long long maxId;
-    time_t now = time(NULL);
-
-    /* If the system clock is moved to the future, and then set back to the
-     * right value, time events may be delayed in a random way. Often this
-     * means that scheduled operations will not be performed soon enough.
-     *
-     * Here we try to detect system clock skews, and force all the time
-     * events to be processed ASAP when this happens: the idea is that
-     * processing events earlier is less dangerous than delaying them
-     * indefinitely, and practice suggests it is. */
-    if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
-        }
+    int idx;
+
+    aeWheelAdvance(eventLoop, aeMonotonicMs());
+
+    /* Only run the events due now, events rescheduled with a zero delay or
+     * created by the callbacks are left for the next iteration. */
+    while ((idx = eventLoop->timeWheel[AE_WHEEL_DUE]) != -1) {
+        aeWheelUnlink(eventLoop, idx);
+        aeWheelLink(eventLoop, idx, AE_WHEEL_RUN);
     }
-    eventLoop->lastTime = now;
-
-    prev = NULL;
-    te = eventLoop->timeEventHead;
-    maxId = eventLoop->timeEventNextId-1;
-    while(te) {
-        long now_sec, now_ms;
-        long long id;
-
-        /* Remove events scheduled for deletion. */
-        if (te->id == AE_DELETED_EVENT_ID) {
-            aeTimeEvent *next = te->next;
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            te = next;
-            continue;
-        }
 
-        /* Make sure we don't process time events created by time events in
-         * this iteration. Note that this check is currently useless: we always
-         * add new timers on the head, however if we change the implementation
-         * detail, this check may be useful again: we keep it here for future
-         * defense. */
-        if (te->id > maxId) {
-            te = te->next;
-            continue;
-        }
-        aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            if (retval != AE_NOMORE) {
-                aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {
-                te->id = AE_DELETED_EVENT_ID;
-            }
+    while ((idx = eventLoop->timeWheel[AE_WHEEL_RUN]) != -1) {
+        aeTimeEvent *te = &eventLoop->timeEvents[idx];
+        int retval;
+
+        aeWheelUnlink(eventLoop, idx);
+        retval = te->timeProc(eventLoop, te->id, te->clientData);
+        processed++;
+
+        /* The callback may have created events and moved the array. */
+        te = &eventLoop->timeEvents[idx];
+        if (retval != AE_NOMORE && te->id != AE_DELETED_EVENT_ID) {
+            te->when = aeMonotonicMs() + retval;
+            aeWheelInsert(eventLoop, idx);
+        } else {
+            aeFreeTimeEvent(eventLoop, idx);
         }
-        prev = te;
-        te = te->next;
     }
     return processed;
 }
@@ -360,30 +571,17 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
     if (eventLoop->maxfd != -1 ||
         ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
         int j;
-        aeTimeEvent *shortest = NULL;
+        long long ms = -1;
         struct timeval tv, *tvp;
 
         if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT))
-            shortest = aeSearchNearestTimer(eventLoop);
-        if (shortest) {
-            long now_sec, now_ms;
-
-            aeGetTime(&now_sec, &now_ms);
-            tvp = &tv;
-
+            ms = aeWheelTimeout(eventLoop);
+        if (ms >= 0) {
             /* How many milliseconds we need to wait for the next
              * time event to fire? */
-            long long ms =
-                (shortest->when_sec - now_sec)*1000 +
-                shortest->when_ms - now_ms;
-
-            if (ms > 0) {
-                tvp->tv_sec = ms/1000;
-                tvp->tv_usec = (ms % 1000)*1000;
-            } else {
-                tvp->tv_sec = 0;
-                tvp->tv_usec = 0;
-            }
+            tvp = &tv;
+            tvp->tv_sec = ms/1000;
+            tvp->tv_usec = (ms % 1000)*1000;
         } else {
             /* If we have to check for events but need to return
              * ASAP because of AE_DONT_WAIT we need to set the timeout
@@ -397,13 +595,24 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags)
             }
         }
 
-        numevents = aeApiPoll(eventLoop, tvp);
+        numevents = eventLoop->api->poll(eventLoop, tvp);
         for (j = 0; j < numevents; j++) {
             aeFileEvent *fe = &eventLoop->events[eventLoop->fired[j].fd];
             int mask = eventLoop->fired[j].mask;
             int fd = eventLoop->fired[j].fd;
             int rfired = 0;
 
+            if (mask & (AE_RECV|AE_SEND)) {
+                aeFiredEvent *fired = &eventLoop->fired[j];
+
+                if (fe->mask & mask & AE_RECV)
+                    fe->recvProc(eventLoop,fd,fe->clientData,fired->buf,fired->res);
+                if (fe->mask & mask & AE_SEND)
+                    fe->sendProc(eventLoop,fd,fe->clientData,fired->res);
+                processed++;
+                continue;
+            }
+
 	    /* note the fe->mask & mask & ... code: maybe an already processed
              * event removed an element that fired and we still didn't
              * processed, so we check if the event is still valid. */
@@ -457,7 +666,13 @@ void aeMain(aeEventLoop *eventLoop) {
 }
 
 char *aeGetApiName(void) {
-    return aeApiName();
+    return aeApiDefault->name();
+}
+
+/* Edge triggered layers report a fd again only once its readiness changes,
+ * callers have to read and write until EAGAIN. */
+int aeGetApiEdgeTriggered(void) {
+    return aeApiDefault->edge;
 }
 
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
@@ -33,6 +33,7 @@
 #ifndef __AE_H__
 #define __AE_H__
 
+#include <stddef.h>
 #include <time.h>
 
 #define AE_OK 0
@@ -41,6 +42,8 @@
 #define AE_NONE 0
 #define AE_READABLE 1
 #define AE_WRITABLE 2
+#define AE_RECV 4
+#define AE_SEND 8
 
 #define AE_FILE_EVENTS 1
 #define AE_TIME_EVENTS 2
@@ -50,52 +53,77 @@
 #define AE_NOMORE -1
 #define AE_DELETED_EVENT_ID -1
 
+/* Time events live in a hierarchical timing wheel with millisecond ticks:
+ * AE_WHEEL_LEVELS levels of AE_WHEEL_SLOTS slots, each level covering
+ * AE_WHEEL_SLOTS times the span of the one below. Two extra buckets hold
+ * events that are due and events being run. */
+#define AE_WHEEL_BITS 6
+#define AE_WHEEL_SLOTS (1 << AE_WHEEL_BITS)
+#define AE_WHEEL_LEVELS 6
+#define AE_WHEEL_DUE (AE_WHEEL_LEVELS * AE_WHEEL_SLOTS)
+#define AE_WHEEL_RUN (AE_WHEEL_DUE + 1)
+#define AE_WHEEL_BUCKETS (AE_WHEEL_RUN + 1)
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
 struct aeEventLoop;
+struct aeApi;
 
 /* Types and data structures */
 typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData, int mask);
 typedef int aeTimeProc(struct aeEventLoop *eventLoop, long long id, void *clientData);
 typedef void aeEventFinalizerProc(struct aeEventLoop *eventLoop, void *clientData);
 typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop);
+typedef void aeRecvProc(struct aeEventLoop *eventLoop, int fd, void *clientData, char *buf, long n);
+typedef void aeSendProc(struct aeEventLoop *eventLoop, int fd, void *clientData, long n);
 
 /* File event structure */
 typedef struct aeFileEvent {
-    int mask; /* one of AE_(READABLE|WRITABLE) */
+    int mask; /* one of AE_(READABLE|WRITABLE|RECV|SEND) */
     aeFileProc *rfileProc;
     aeFileProc *wfileProc;
+    aeRecvProc *recvProc;
+    aeSendProc *sendProc;
     void *clientData;
 } aeFileEvent;
 
 /* Time event structure */
 typedef struct aeTimeEvent {
     long long id; /* time event identifier. */
-    long when_sec; /* seconds */
-    long when_ms; /* milliseconds */
+    long long when; /* monotonic milliseconds */
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    unsigned int gen; /* bumped each time the slot is reused */
+    int bucket; /* wheel bucket holding the event, -1 while running */
+    int prev;
+    int next;
 } aeTimeEvent;
 
 /* A fired event */
 typedef struct aeFiredEvent {
     int fd;
     int mask;
+    long res; /* bytes received, or result of a failed AE_SEND */
+    char *buf; /* received data, valid until the next poll */
 } aeFiredEvent;
 
 /* State of an event based program */
 typedef struct aeEventLoop {
     int maxfd;   /* highest file descriptor currently registered */
     int setsize; /* max number of file descriptors tracked */
-    long long timeEventNextId;
-    time_t lastTime;     /* Used to detect system clock skew */
     aeFileEvent *events; /* Registered events */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeEvent *timeEvents; /* Time events, indexed by the low bits of id */
+    int timeEventSize;
+    int timeEventFree; /* Head of the list of unused time events */
+    int timeEventCount;
+    long long timeNow; /* Last wheel tick processed */
+    int timeWheel[AE_WHEEL_BUCKETS]; /* Heads of the bucket lists */
+    unsigned long long timeWheelUsed[AE_WHEEL_LEVELS]; /* Non-empty slots */
     int stop;
+    const struct aeApi *api; /* Multiplexing layer used by this loop */
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
 } aeEventLoop;
@@ -107,6 +135,11 @@ void aeStop(aeEventLoop *eventLoop);
 int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
         aeFileProc *proc, void *clientData);
 void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask);
+int aeSetRecvBuffers(aeEventLoop *eventLoop, size_t size);
+int aeCreateRecvEvent(aeEventLoop *eventLoop, int fd,
+        aeRecvProc *proc, void *clientData);
+int aeSend(aeEventLoop *eventLoop, int fd, char *buf, size_t len,
+        aeSendProc *proc, void *clientData);
 int aeGetFileEvents(aeEventLoop *eventLoop, int fd);
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
@@ -116,6 +149,8 @@ int aeProcessEvents(aeEventLoop *eventLoop, int flags);
 int aeWait(int fd, int mask, long long milliseconds);
 void aeMain(aeEventLoop *eventLoop);
 char *aeGetApiName(void);
+int aeSetApi(char *name);
+int aeGetApiEdgeTriggered(void);
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
 int aeGetSetSize(aeEventLoop *eventLoop);
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
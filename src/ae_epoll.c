@@ -33,6 +33,7 @@
 
 typedef struct aeApiState {
     int epfd;
+    int edge; /* EPOLLET, callers must drain fds until EAGAIN */
     struct epoll_event *events;
 } aeApiState;
 
@@ -45,6 +46,7 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
         zfree(state);
         return -1;
     }
+    state->edge = 0;
     state->epfd = epoll_create(1024); /* 1024 is just a hint for the kernel */
     if (state->epfd == -1) {
         zfree(state->events);
@@ -55,6 +57,12 @@ static int aeApiCreate(aeEventLoop *eventLoop) {
     return 0;
 }
 
+static int aeApiCreateEdge(aeEventLoop *eventLoop) {
+    if (aeApiCreate(eventLoop) == -1) return -1;
+    ((aeApiState *) eventLoop->apidata)->edge = 1;
+    return 0;
+}
+
 static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
     aeApiState *state = eventLoop->apidata;
 
@@ -82,6 +90,7 @@ static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
     mask |= eventLoop->events[fd].mask; /* Merge old events */
     if (mask & AE_READABLE) ee.events |= EPOLLIN;
     if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
+    if (state->edge) ee.events |= EPOLLET;
     ee.data.fd = fd;
     if (epoll_ctl(state->epfd,op,fd,&ee) == -1) return -1;
     return 0;
@@ -95,6 +104,7 @@ static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
     ee.events = 0;
     if (mask & AE_READABLE) ee.events |= EPOLLIN;
     if (mask & AE_WRITABLE) ee.events |= EPOLLOUT;
+    if (state->edge) ee.events |= EPOLLET;
     ee.data.fd = fd;
     if (mask != AE_NONE) {
         epoll_ctl(state->epfd,EPOLL_CTL_MOD,fd,&ee);
@@ -133,3 +143,7 @@ static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
 static char *aeApiName(void) {
     return "epoll";
 }
+
+static char *aeApiNameEdge(void) {
+    return "epoll-et";
+}
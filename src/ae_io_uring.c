@@ -0,0 +1,536 @@
+/* Linux io_uring(7) based ae.c module
+ *
+ * Readiness is tracked with one-shot IORING_OP_POLL_ADD requests, one per
+ * registered fd. Changes to the interest set are queued in the submission
+ * ring and handed to the kernel together with the wait for completions, so
+ * a loop iteration costs a single io_uring_enter(2) call no matter how many
+ * events were added or removed since the last one.
+ *
+ * Each poll request carries the fd and a per-fd generation in its user
+ * data. Removing or changing the interest set bumps the generation, which
+ * makes completions of requests that were already in flight stale. A fired
+ * request is gone, so fds that fired are armed again with their current
+ * mask before the next wait, which keeps the level-triggered semantics the
+ * rest of ae expects.
+ *
+ * Callers can also hand their I/O to the ring: aeSend queues an
+ * IORING_OP_SEND and aeCreateRecvEvent a multishot IORING_OP_RECV that
+ * picks buffers from a ring registered with IORING_REGISTER_PBUF_RING.
+ * Received data is returned as fired events with the buffer, which is
+ * given back to the kernel by the next poll. Sends wait for all data to
+ * be sent and only complete when they fail. A request and its response
+ * then need no system calls besides the shared io_uring_enter(2).
+ */
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define AE_URING_MIN_ENTRIES 64
+#define AE_URING_MAX_ENTRIES 4096
+#define AE_URING_REMOVE UINT64_MAX
+#define AE_URING_GEN_MASK 0xffffff
+#define AE_URING_BUF_MEMORY (4 << 20) /* receive buffers per loop */
+#define AE_URING_BUF_MIN 16
+#define AE_URING_BUF_MAX 4096
+
+/* Kinds of requests, each with its own generation per fd. */
+#define AE_URING_POLL 0
+#define AE_URING_RECV 1
+#define AE_URING_SEND 2
+#define AE_URING_KINDS 3
+
+typedef struct aeUringState {
+    int ringfd;
+    void *sqmap;
+    void *cqmap;
+    size_t sqlen;
+    size_t cqlen;
+    struct io_uring_sqe *sqes;
+    size_t sqeslen;
+    unsigned *sqhead;
+    unsigned *sqtail;
+    unsigned *sqarray;
+    unsigned sqmask;
+    unsigned sqentries;
+    unsigned tail;
+    unsigned *cqhead;
+    unsigned *cqtail;
+    unsigned cqmask;
+    struct io_uring_cqe *cqes;
+    uint32_t *gen[AE_URING_KINDS]; /* generation of each kind, per fd */
+    int *armed;      /* mask of the outstanding poll, per fd */
+    int *rearm;      /* fds whose poll fired since the last wait */
+    int nrearm;
+    int nfired;      /* events returned by the last poll */
+    struct io_uring_buf_ring *br; /* provided buffers, NULL until set up */
+    size_t brlen;
+    unsigned brmask;
+    char *bufs;
+    size_t bufsize;
+    unsigned short *held; /* buffers handed out by the last poll */
+    int nheld;
+} aeUringState;
+
+static int aeUringEnter(aeUringState *state, unsigned submit, unsigned wait,
+        unsigned flags, void *arg, size_t argsz) {
+    return (int) syscall(__NR_io_uring_enter, state->ringfd, submit, wait,
+            flags, arg, argsz);
+}
+
+static void aeUringUnmap(aeUringState *state) {
+    if (state->sqes) munmap(state->sqes, state->sqeslen);
+    if (state->cqmap && state->cqmap != state->sqmap)
+        munmap(state->cqmap, state->cqlen);
+    if (state->sqmap) munmap(state->sqmap, state->sqlen);
+}
+
+static void aeUringFreeBuffers(aeUringState *state) {
+    if (state->br) munmap(state->br, state->brlen);
+    zfree(state->bufs);
+    zfree(state->held);
+    state->br = NULL;
+    state->bufs = NULL;
+    state->held = NULL;
+}
+
+static void aeUringFreeState(aeUringState *state) {
+    int k;
+
+    aeUringUnmap(state);
+    if (state->ringfd != -1) close(state->ringfd);
+    aeUringFreeBuffers(state);
+    for (k = 0; k < AE_URING_KINDS; k++) zfree(state->gen[k]);
+    zfree(state->armed);
+    zfree(state->rearm);
+    zfree(state);
+}
+
+static int aeUringCreate(aeEventLoop *eventLoop) {
+    aeUringState *state = zcalloc(sizeof(aeUringState));
+    struct io_uring_params p;
+    unsigned entries = AE_URING_MIN_ENTRIES;
+    char *base;
+    int k;
+
+    if (!state) return -1;
+    state->ringfd = -1;
+    for (k = 0; k < AE_URING_KINDS; k++) {
+        state->gen[k] = zcalloc(sizeof(uint32_t)*eventLoop->setsize);
+        if (!state->gen[k]) goto err;
+    }
+    state->armed = zcalloc(sizeof(int)*eventLoop->setsize);
+    state->rearm = zcalloc(sizeof(int)*eventLoop->setsize);
+    if (!state->armed || !state->rearm) goto err;
+
+    while (entries < (unsigned) eventLoop->setsize && entries < AE_URING_MAX_ENTRIES)
+        entries <<= 1;
+
+    memset(&p, 0, sizeof(p));
+    state->ringfd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if (state->ringfd == -1) goto err;
+
+    /* Timeouts are passed to io_uring_enter(2) directly, which needs 5.11+. */
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+        goto err;
+    }
+
+    state->sqlen = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cqlen = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cqlen > state->sqlen) state->sqlen = state->cqlen;
+        state->cqlen = state->sqlen;
+    }
+
+    state->sqmap = mmap(NULL, state->sqlen, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_SQ_RING);
+    if (state->sqmap == MAP_FAILED) {
+        state->sqmap = NULL;
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cqmap = state->sqmap;
+    } else {
+        state->cqmap = mmap(NULL, state->cqlen, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_CQ_RING);
+        if (state->cqmap == MAP_FAILED) {
+            state->cqmap = NULL;
+            goto err;
+        }
+    }
+    state->sqeslen = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL, state->sqeslen, PROT_READ|PROT_WRITE,
+            MAP_SHARED|MAP_POPULATE, state->ringfd, IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        state->sqes = NULL;
+        goto err;
+    }
+
+    base = state->sqmap;
+    state->sqhead = (unsigned *) (base + p.sq_off.head);
+    state->sqtail = (unsigned *) (base + p.sq_off.tail);
+    state->sqarray = (unsigned *) (base + p.sq_off.array);
+    state->sqmask = *(unsigned *) (base + p.sq_off.ring_mask);
+    state->sqentries = p.sq_entries;
+    state->tail = *state->sqtail;
+
+    base = state->cqmap;
+    state->cqhead = (unsigned *) (base + p.cq_off.head);
+    state->cqtail = (unsigned *) (base + p.cq_off.tail);
+    state->cqmask = *(unsigned *) (base + p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe *) (base + p.cq_off.cqes);
+
+    eventLoop->apidata = state;
+    return 0;
+
+err:
+    aeUringFreeState(state);
+    return -1;
+}
+
+static int aeUringResize(aeEventLoop *eventLoop, int setsize) {
+    aeUringState *state = eventLoop->apidata;
+    int j, k;
+
+    for (k = 0; k < AE_URING_KINDS; k++)
+        state->gen[k] = zrealloc(state->gen[k], sizeof(uint32_t)*setsize);
+    state->armed = zrealloc(state->armed, sizeof(int)*setsize);
+    state->rearm = zrealloc(state->rearm, sizeof(int)*setsize);
+    for (j = eventLoop->setsize; j < setsize; j++) {
+        for (k = 0; k < AE_URING_KINDS; k++) state->gen[k][j] = 0;
+        state->armed[j] = AE_NONE;
+    }
+    return 0;
+}
+
+static void aeUringFree(aeEventLoop *eventLoop) {
+    aeUringFreeState(eventLoop->apidata);
+}
+
+/* Hand every queued entry to the kernel without waiting for completions. */
+static void aeUringFlush(aeUringState *state) {
+    unsigned pending;
+
+    __atomic_store_n(state->sqtail, state->tail, __ATOMIC_RELEASE);
+    pending = state->tail - __atomic_load_n(state->sqhead, __ATOMIC_ACQUIRE);
+    if (pending) aeUringEnter(state, pending, 0, 0, NULL, 0);
+}
+
+static struct io_uring_sqe *aeUringGetSqe(aeUringState *state) {
+    struct io_uring_sqe *sqe;
+    unsigned index;
+
+    if (state->tail - __atomic_load_n(state->sqhead, __ATOMIC_ACQUIRE) >= state->sqentries) {
+        aeUringFlush(state);
+        if (state->tail - __atomic_load_n(state->sqhead, __ATOMIC_ACQUIRE) >= state->sqentries)
+            return NULL;
+    }
+    index = state->tail & state->sqmask;
+    sqe = &state->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    state->sqarray[index] = index;
+    state->tail++;
+    return sqe;
+}
+
+/* User data of a request: the kind, the low bits of its generation and
+ * the fd. */
+static uint64_t aeUringData(aeUringState *state, int kind, int fd) {
+    return ((uint64_t) kind << 56) |
+        ((uint64_t) (state->gen[kind][fd] & AE_URING_GEN_MASK) << 32) |
+        (uint32_t) fd;
+}
+
+static int aeUringPollAdd(aeUringState *state, int fd, int mask) {
+    struct io_uring_sqe *sqe = aeUringGetSqe(state);
+
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    if (mask & AE_READABLE) sqe->poll_events |= POLLIN;
+    if (mask & AE_WRITABLE) sqe->poll_events |= POLLOUT;
+    sqe->user_data = aeUringData(state, AE_URING_POLL, fd);
+    state->armed[fd] = mask;
+    return 0;
+}
+
+/* Cancel the outstanding poll of fd, if any. Its completion, if it is
+ * already on the way, is ignored because the generation no longer matches. */
+static void aeUringPollRemove(aeUringState *state, int fd) {
+    if (state->armed[fd] != AE_NONE) {
+        struct io_uring_sqe *sqe = aeUringGetSqe(state);
+
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->addr = aeUringData(state, AE_URING_POLL, fd);
+            sqe->user_data = AE_URING_REMOVE;
+        }
+        state->armed[fd] = AE_NONE;
+    }
+    state->gen[AE_URING_POLL][fd]++;
+}
+
+/* Cancel the outstanding receive or sends of fd, like aeUringPollRemove. */
+static void aeUringCancel(aeUringState *state, int kind, int fd) {
+    struct io_uring_sqe *sqe = aeUringGetSqe(state);
+
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = aeUringData(state, kind, fd);
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = AE_URING_REMOVE;
+    }
+    state->gen[kind][fd]++;
+}
+
+static int aeUringAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeUringState *state = eventLoop->apidata;
+
+    mask |= eventLoop->events[fd].mask; /* Merge old events */
+    mask &= AE_READABLE|AE_WRITABLE;
+    if (state->armed[fd] == mask) return 0;
+    aeUringPollRemove(state, fd);
+    return aeUringPollAdd(state, fd, mask);
+}
+
+static void aeUringDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeUringState *state = eventLoop->apidata;
+    int mask = eventLoop->events[fd].mask & (~delmask);
+    int j;
+
+    if (delmask & (AE_READABLE|AE_WRITABLE)) {
+        aeUringPollRemove(state, fd);
+        mask &= AE_READABLE|AE_WRITABLE;
+        if (mask != AE_NONE) aeUringPollAdd(state, fd, mask);
+    }
+
+    delmask &= eventLoop->events[fd].mask & (AE_RECV|AE_SEND);
+    if (delmask == AE_NONE) return;
+    if (delmask & AE_RECV) aeUringCancel(state, AE_URING_RECV, fd);
+    if (delmask & AE_SEND) aeUringCancel(state, AE_URING_SEND, fd);
+
+    /* Drop completions of the last poll that were not dispatched yet, and
+     * submit right away: the caller usually closes fd next, and the number
+     * may be reused before the queued requests reach the kernel. */
+    for (j = 0; j < state->nfired; j++) {
+        if (eventLoop->fired[j].fd == fd) eventLoop->fired[j].mask &= ~delmask;
+    }
+    aeUringFlush(state);
+}
+
+/* Give the buffers handed out by the last poll back to the kernel. Only
+ * the address, length and id are written, the ring tail overlays the
+ * reserved field of the first entry. */
+static void aeUringReturnBuffers(aeUringState *state) {
+    unsigned short tail;
+    int j;
+
+    if (!state->nheld) return;
+    tail = state->br->tail;
+    for (j = 0; j < state->nheld; j++) {
+        struct io_uring_buf *buf = &state->br->bufs[(tail + j) & state->brmask];
+        unsigned short bid = state->held[j];
+
+        buf->addr = (uint64_t) (uintptr_t) (state->bufs + (size_t) bid*state->bufsize);
+        buf->len = state->bufsize;
+        buf->bid = bid;
+    }
+    __atomic_store_n(&state->br->tail, (unsigned short) (tail + state->nheld), __ATOMIC_RELEASE);
+    state->nheld = 0;
+}
+
+static int aeUringBuffers(aeEventLoop *eventLoop, size_t size) {
+    aeUringState *state = eventLoop->apidata;
+    struct io_uring_probe *probe;
+    struct io_uring_buf_reg reg;
+    unsigned count = AE_URING_BUF_MAX, j;
+    int supported;
+
+    /* Multishot receives came in 6.0, together with IORING_OP_SEND_ZC. */
+    probe = zcalloc(sizeof(*probe) + 256*sizeof(struct io_uring_probe_op));
+    supported = syscall(__NR_io_uring_register, state->ringfd,
+            IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_SEND_ZC;
+    zfree(probe);
+    if (!supported || size == 0 || size > UINT32_MAX) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    aeUringFreeBuffers(state);
+    while (count > AE_URING_BUF_MIN && count*size > AE_URING_BUF_MEMORY)
+        count >>= 1;
+
+    state->brlen = count*sizeof(struct io_uring_buf);
+    state->br = mmap(NULL, state->brlen, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (state->br == MAP_FAILED) {
+        state->br = NULL;
+        return -1;
+    }
+    state->brmask = count - 1;
+    state->bufs = zmalloc(count*size);
+    state->bufsize = size;
+    state->held = zmalloc(count*sizeof(unsigned short));
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) state->br;
+    reg.ring_entries = count;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, state->ringfd,
+                IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        aeUringFreeBuffers(state);
+        return -1;
+    }
+
+    for (j = 0; j < count; j++) state->held[j] = j;
+    state->nheld = count;
+    aeUringReturnBuffers(state);
+    return 0;
+}
+
+static int aeUringRecv(aeEventLoop *eventLoop, int fd) {
+    aeUringState *state = eventLoop->apidata;
+    struct io_uring_sqe *sqe;
+
+    if (!state->br) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (!(sqe = aeUringGetSqe(state))) {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = aeUringData(state, AE_URING_RECV, fd);
+    return 0;
+}
+
+static int aeUringSend(aeEventLoop *eventLoop, int fd, char *buf, size_t len) {
+    aeUringState *state = eventLoop->apidata;
+    struct io_uring_sqe *sqe;
+
+    if (!state->br) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (!(sqe = aeUringGetSqe(state))) {
+        errno = EBUSY;
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL|MSG_WAITALL;
+    sqe->user_data = aeUringData(state, AE_URING_SEND, fd);
+    return 0;
+}
+
+static int aeUringPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeUringState *state = eventLoop->apidata;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned head, tail, pending;
+    int j, numevents = 0;
+
+    state->nfired = 0;
+    if (state->br) aeUringReturnBuffers(state);
+
+    for (j = 0; j < state->nrearm; j++) {
+        int fd = state->rearm[j];
+        int mask = eventLoop->events[fd].mask & (AE_READABLE|AE_WRITABLE);
+
+        if (mask != AE_NONE && state->armed[fd] == AE_NONE)
+            aeUringPollAdd(state, fd, mask);
+    }
+    state->nrearm = 0;
+
+    memset(&arg, 0, sizeof(arg));
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec*1000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    __atomic_store_n(state->sqtail, state->tail, __ATOMIC_RELEASE);
+    pending = state->tail - __atomic_load_n(state->sqhead, __ATOMIC_ACQUIRE);
+    aeUringEnter(state, pending, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+            &arg, sizeof(arg));
+
+    head = *state->cqhead;
+    tail = __atomic_load_n(state->cqtail, __ATOMIC_ACQUIRE);
+    while (head != tail && numevents < eventLoop->setsize) {
+        struct io_uring_cqe *cqe = &state->cqes[head & state->cqmask];
+        uint64_t data = cqe->user_data;
+        int fd = (int) (uint32_t) data;
+        int kind = (int) (data >> 56);
+        aeFiredEvent *fired = &eventLoop->fired[numevents];
+        char *buf = NULL;
+        int mask = 0;
+
+        head++;
+        if (data == AE_URING_REMOVE || fd >= eventLoop->setsize) continue;
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            state->held[state->nheld++] = bid;
+            buf = state->bufs + (size_t) bid*state->bufsize;
+        }
+        if (((data >> 32) & AE_URING_GEN_MASK) !=
+                (state->gen[kind][fd] & AE_URING_GEN_MASK)) continue;
+
+        if (kind == AE_URING_SEND) {
+            fired->fd = fd;
+            fired->mask = AE_SEND;
+            fired->res = cqe->res;
+            fired->buf = NULL;
+            numevents++;
+            continue;
+        }
+        if (kind == AE_URING_RECV) {
+            /* A multishot receive stops when the buffers run out or it
+             * failed, start it again unless the peer closed or it failed. */
+            if (!(cqe->flags & IORING_CQE_F_MORE) &&
+                    (cqe->res > 0 || cqe->res == -ENOBUFS))
+                aeUringRecv(eventLoop, fd);
+            if (cqe->res == -ENOBUFS) continue;
+            fired->fd = fd;
+            fired->mask = AE_RECV;
+            fired->res = cqe->res;
+            fired->buf = buf;
+            numevents++;
+            continue;
+        }
+
+        state->armed[fd] = AE_NONE;
+        state->rearm[state->nrearm++] = fd;
+
+        if (cqe->res < 0) {
+            mask |= AE_WRITABLE;
+        } else {
+            if (cqe->res & POLLIN) mask |= AE_READABLE;
+            if (cqe->res & POLLOUT) mask |= AE_WRITABLE;
+            if (cqe->res & POLLERR) mask |= AE_WRITABLE;
+            if (cqe->res & POLLHUP) mask |= AE_WRITABLE;
+        }
+        fired->fd = fd;
+        fired->mask = mask;
+        numevents++;
+    }
+    __atomic_store_n(state->cqhead, head, __ATOMIC_RELEASE);
+
+    state->nfired = numevents;
+    return numevents;
+}
+
+static char *aeUringName(void) {
+    return "io_uring";
+}
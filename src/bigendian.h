@@ -0,0 +1,28 @@
+#ifndef BIGENDIAN_H
+#define BIGENDIAN_H
+
+#include <stdint.h>
+
+// network byte order integers of the HdrHistogram encodings
+
+static inline void put_u32(uint8_t *buf, uint32_t n) {
+    for (int i = 0; i < 4; i++) buf[i] = n >> (24 - i * 8);
+}
+
+static inline void put_u64(uint8_t *buf, uint64_t n) {
+    for (int i = 0; i < 8; i++) buf[i] = n >> (56 - i * 8);
+}
+
+static inline uint32_t get_u32(uint8_t *buf) {
+    uint32_t n = 0;
+    for (int i = 0; i < 4; i++) n = (n << 8) | buf[i];
+    return n;
+}
+
+static inline uint64_t get_u64(uint8_t *buf) {
+    uint64_t n = 0;
+    for (int i = 0; i < 8; i++) n = (n << 8) | buf[i];
+    return n;
+}
+
+#endif /* BIGENDIAN_H */
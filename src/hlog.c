@@ -0,0 +1,207 @@
+// HdrHistogram interval log format, see HistogramLogWriter in
+// https://github.com/HdrHistogram/HdrHistogram
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <zlib.h>
+
+#include "hlog.h"
+#include "bigendian.h"
+#include "zmalloc.h"
+
+#define COMPRESSED_COOKIE 0x1c849314
+
+static const char base64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static char *base64_encode(uint8_t *data, size_t len) {
+    char *out = zmalloc((len + 2) / 3 * 4 + 1), *c = out;
+
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t n = data[i] << 16;
+        if (i + 1 < len) n |= data[i + 1] << 8;
+        if (i + 2 < len) n |= data[i + 2];
+        *c++ = base64[(n >> 18) & 63];
+        *c++ = base64[(n >> 12) & 63];
+        *c++ = i + 1 < len ? base64[(n >> 6) & 63] : '=';
+        *c++ = i + 2 < len ? base64[n & 63] : '=';
+    }
+    *c = '\0';
+
+    return out;
+}
+
+static uint8_t *base64_decode(char *s, size_t *len) {
+    size_t n = strlen(s);
+    uint8_t *out = zmalloc(n / 4 * 3 + 3);
+    uint32_t bits = 0;
+    int count = 0;
+
+    *len = 0;
+    for (char *c = s; *c && *c != '='; c++) {
+        char *p = strchr(base64, *c);
+        if (!p) {
+            zfree(out);
+            return NULL;
+        }
+        bits = (bits << 6) | (p - base64);
+        if (++count == 4) {
+            out[(*len)++] = bits >> 16;
+            out[(*len)++] = bits >> 8;
+            out[(*len)++] = bits;
+            bits = count = 0;
+        }
+    }
+
+    if (count == 3) {
+        out[(*len)++] = bits >> 10;
+        out[(*len)++] = bits >> 2;
+    } else if (count == 2) {
+        out[(*len)++] = bits >> 4;
+    }
+
+    return out;
+}
+
+static char *hlog_compress(stats *stats) {
+    uint8_t *encoded, *data;
+    size_t len = stats_encode(stats, &encoded);
+    uLongf size = compressBound(len);
+    char *out = NULL;
+
+    data = zmalloc(size + 8);
+    if (compress2(data + 8, &size, encoded, len, Z_DEFAULT_COMPRESSION) == Z_OK) {
+        put_u32(&data[0], COMPRESSED_COOKIE);
+        put_u32(&data[4], size);
+        out = base64_encode(data, size + 8);
+    }
+
+    zfree(encoded);
+    zfree(data);
+    return out;
+}
+
+static stats *hlog_decompress(char *s) {
+    size_t len;
+    uint8_t *data = base64_decode(s, &len);
+    stats *stats = NULL;
+
+    if (!data) return NULL;
+
+    if (len >= 8 && get_u32(data) == COMPRESSED_COOKIE && get_u32(&data[4]) <= len - 8) {
+        uLongf capacity = 1 << 16, size;
+        uint8_t *encoded = NULL;
+        int rc;
+
+        do {
+            capacity *= 2;
+            encoded = zrealloc(encoded, capacity);
+            size = capacity;
+            rc = uncompress(encoded, &size, data + 8, get_u32(&data[4]));
+        } while (rc == Z_BUF_ERROR && capacity < (1 << 30));
+
+        if (rc == Z_OK) stats = stats_decode(encoded, size);
+        zfree(encoded);
+    }
+
+    zfree(data);
+    return stats;
+}
+
+static stats *hlog_merge(stats *dst, stats *src) {
+    if (!dst) return src;
+
+    if (src->limit > dst->limit) {
+        stats *tmp = dst;
+        dst = src;
+        src = tmp;
+    }
+
+    stats_merge(dst, src);
+    stats_free(src);
+    return dst;
+}
+
+void hlog_header(FILE *file, uint64_t start) {
+    long double start_s = start / 1000000.0L;
+    fprintf(file, "#[Histogram log format version 1.3]\n");
+    fprintf(file, "#[StartTime: %.3Lf (seconds since epoch)]\n", start_s);
+    fprintf(file, "#[BaseTime: %.3Lf (seconds since epoch)]\n", start_s);
+    fprintf(file, "\"StartTimestamp\",\"Interval_Length\",\"Interval_Max\",\"Interval_Compressed_Histogram\"\n");
+    fflush(file);
+}
+
+int hlog_write(FILE *file, char *tag, uint64_t start, uint64_t length, stats *stats) {
+    char *histogram = hlog_compress(stats);
+    if (!histogram) return -1;
+
+    if (tag) fprintf(file, "Tag=%s,", tag);
+    fprintf(file, "%.3Lf,%.3Lf,%.3Lf,%s\n",
+            start / 1000000.0L, length / 1000000.0L,
+            stats->max / 1000.0L, histogram);
+    fflush(file);
+
+    zfree(histogram);
+    return 0;
+}
+
+// Merge the histograms in a log into *latency. The run totals written with
+// Tag=total are used when present, otherwise the untagged intervals.
+int hlog_read(char *path, stats **latency) {
+    FILE *file = fopen(path, "r");
+    stats *total = NULL, *intervals = NULL;
+    char *line = NULL;
+    size_t size = 0;
+    int rc = 0;
+
+    if (!file) return -1;
+
+    while (getline(&line, &size, file) > 0) {
+        char *s = line, *tag = NULL;
+        stats *stats;
+
+        if (*s == '#' || *s == '"' || *s == '\n') continue;
+
+        if (!strncmp(s, "Tag=", 4)) {
+            tag = s + 4;
+            if (!(s = strchr(s, ','))) goto error;
+            *s++ = '\0';
+        }
+
+        for (int i = 0; i < 3; i++) {
+            if (!(s = strchr(s, ','))) goto error;
+            s++;
+        }
+        s[strcspn(s, "\r\n")] = '\0';
+
+        if (!(stats = hlog_decompress(s))) goto error;
+
+        if (tag && !strcmp(tag, "total")) {
+            total = hlog_merge(total, stats);
+        } else if (!tag) {
+            intervals = hlog_merge(intervals, stats);
+        } else {
+            stats_free(stats);
+        }
+    }
+
+    if (total) {
+        *latency = hlog_merge(*latency, total);
+        if (intervals) stats_free(intervals);
+    } else if (intervals) {
+        *latency = hlog_merge(*latency, intervals);
+    }
+
+    goto done;
+
+  error:
+    rc = -1;
+    if (total) stats_free(total);
+    if (intervals) stats_free(intervals);
+
+  done:
+    free(line);
+    fclose(file);
+    return rc;
+}
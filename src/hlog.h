@@ -0,0 +1,12 @@
+#ifndef HLOG_H
+#define HLOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "stats.h"
+
+void hlog_header(FILE *, uint64_t);
+int hlog_write(FILE *, char *, uint64_t, uint64_t, stats *);
+int hlog_read(char *, stats **);
+
+#endif /* HLOG_H */
@@ -0,0 +1,521 @@
+// Minimal HTTP/2 client framing, see RFC 9113 and RFC 7541
+//
+// Requests are encoded without the HPACK dynamic table and the server is
+// told to not use one either with SETTINGS_HEADER_TABLE_SIZE 0, so the
+// only part of a response header block that is decoded is :status. The
+// receive windows are opened up front and replenished in large steps.
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http2.h"
+#include "zmalloc.h"
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+#define HTTP2_DATA          0x0
+#define HTTP2_HEADERS       0x1
+#define HTTP2_RST_STREAM    0x3
+#define HTTP2_SETTINGS      0x4
+#define HTTP2_PUSH_PROMISE  0x5
+#define HTTP2_PING          0x6
+#define HTTP2_GOAWAY        0x7
+#define HTTP2_WINDOW_UPDATE 0x8
+#define HTTP2_CONTINUATION  0x9
+
+#define HTTP2_END_STREAM    0x1
+#define HTTP2_ACK           0x1
+#define HTTP2_END_HEADERS   0x4
+#define HTTP2_PADDED        0x8
+#define HTTP2_PRIORITY      0x20
+
+#define HTTP2_HEADER_TABLE_SIZE      0x1
+#define HTTP2_ENABLE_PUSH            0x2
+#define HTTP2_MAX_CONCURRENT_STREAMS 0x3
+#define HTTP2_INITIAL_WINDOW_SIZE    0x4
+#define HTTP2_MAX_FRAME_SIZE         0x5
+
+#define HTTP2_DEFAULT_WINDOW 65535
+#define HTTP2_DEFAULT_FRAME  16384
+#define HTTP2_MAX_FRAME      16777215
+#define HTTP2_MAX_WINDOW     0x7fffffff
+#define HTTP2_MAX_STREAM_ID  0x7fffffff
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+    size_t   cap;
+} bytes;
+
+static void bytes_append(bytes *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        while (b->len + len > b->cap) b->cap = b->cap ? b->cap * 2 : 256;
+        b->data = zrealloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void bytes_byte(bytes *b, uint8_t c) {
+    bytes_append(b, &c, 1);
+}
+
+static uint32_t read32(uint8_t *p) {
+    return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// HPACK integer with an n bit prefix, the first byte carries the flags
+static void hpack_int(bytes *b, uint8_t flags, int n, size_t value) {
+    size_t max = (1 << n) - 1;
+    if (value < max) {
+        bytes_byte(b, flags | value);
+        return;
+    }
+    bytes_byte(b, flags | max);
+    for (value -= max; value >= 128; value >>= 7) {
+        bytes_byte(b, (value & 127) | 128);
+    }
+    bytes_byte(b, value);
+}
+
+static void hpack_string(bytes *b, const char *s, size_t len) {
+    hpack_int(b, 0, 7, len);
+    bytes_append(b, s, len);
+}
+
+static void hpack_lower(bytes *b, const char *s, size_t len) {
+    hpack_int(b, 0, 7, len);
+    for (size_t i = 0; i < len; i++) bytes_byte(b, tolower((unsigned char) s[i]));
+}
+
+static bool hpack_read_int(uint8_t **p, uint8_t *end, int n, uint64_t *value) {
+    uint64_t max = (1 << n) - 1;
+    int shift = 0;
+
+    *value = *(*p)++ & max;
+    if (*value < max) return true;
+
+    while (*p < end && shift < 56) {
+        uint8_t c = *(*p)++;
+        *value += (uint64_t) (c & 127) << shift;
+        if (!(c & 128)) return true;
+        shift += 7;
+    }
+    return false;
+}
+
+// status codes only contain digits, whose Huffman codes are 00000 to
+// 00010 for 0-2 and 011001 to 011111 for 3-9
+static uint32_t hpack_huffman_status(uint8_t *p, size_t len) {
+    uint64_t bits = 0;
+    uint32_t status = 0;
+    int count = 0;
+
+    for (size_t i = 0; i < len && i < 8; i++) {
+        bits = bits << 8 | p[i];
+        count += 8;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (count < 5) return 0;
+        uint32_t code = (bits >> (count - 5)) & 0x1f;
+        if (code <= 2) {
+            status = status * 10 + code;
+            count -= 5;
+            continue;
+        }
+        if (count < 6) return 0;
+        code = (bits >> (count - 6)) & 0x3f;
+        if (code < 0x19) return 0;
+        status = status * 10 + code - 0x19 + 3;
+        count -= 6;
+    }
+
+    return status;
+}
+
+static uint32_t hpack_status(uint8_t *p, size_t len) {
+    static const uint32_t codes[] = { 200, 204, 206, 304, 400, 404, 500 };
+    uint8_t *end = p + len;
+    uint64_t index, n;
+
+    // skip dynamic table size updates
+    while (p < end && (*p & 0xe0) == 0x20) {
+        if (!hpack_read_int(&p, end, 5, &index)) return 0;
+    }
+    if (p >= end) return 0;
+
+    if (*p & 0x80) {
+        if (!hpack_read_int(&p, end, 7, &index)) return 0;
+        return index >= 8 && index <= 14 ? codes[index - 8] : 0;
+    }
+
+    // a literal, the name must be :status from the static table
+    if (!hpack_read_int(&p, end, (*p & 0x40) ? 6 : 4, &index)) return 0;
+    if (index < 8 || index > 14 || p >= end) return 0;
+
+    bool huffman = *p & 0x80;
+    if (!hpack_read_int(&p, end, 7, &n) || n > (uint64_t) (end - p)) return 0;
+    if (huffman) return hpack_huffman_status(p, n);
+
+    uint32_t status = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (!isdigit(p[i])) return 0;
+        status = status * 10 + p[i] - '0';
+    }
+    return status;
+}
+
+static bool header_skipped(const char *name, size_t len, const char *value, size_t vlen) {
+    static const char *hop[] = {
+        "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", NULL
+    };
+    for (int i = 0; hop[i]; i++) {
+        if (strlen(hop[i]) == len && !strncasecmp(name, hop[i], len)) return true;
+    }
+    if (len == 2 && !strncasecmp(name, "te", 2)) {
+        return !(vlen == 8 && !strncasecmp(value, "trailers", 8));
+    }
+    return false;
+}
+
+static char *find_crlf(char *p, char *end) {
+    for (; p + 1 < end; p++) {
+        if (p[0] == '\r' && p[1] == '\n') return p;
+    }
+    return NULL;
+}
+
+// convert an HTTP/1.1 request as built by wrk.format() to a header block
+bool http2_request_encode(http2_request *r, char *req, size_t len, char *host, bool tls) {
+    char *end = req + len, *line, *eol, *method_end, *path, *path_end;
+    char *authority = host;
+    size_t alen = strlen(host);
+    bytes block = { 0 }, headers = { 0 };
+
+    if (!(eol = find_crlf(req, end))) return false;
+    if (!(method_end = memchr(req, ' ', eol - req))) return false;
+    path = method_end + 1;
+    if (!(path_end = memchr(path, ' ', eol - path))) return false;
+
+    for (line = eol + 2; ; line = eol + 2) {
+        if (!(eol = find_crlf(line, end))) goto error;
+        if (eol == line) break;
+
+        char *colon = memchr(line, ':', eol - line);
+        if (!colon) goto error;
+
+        char *value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) value++;
+        size_t nlen = colon - line, vlen = eol - value;
+
+        if (nlen == 4 && !strncasecmp(line, "host", 4)) {
+            authority = value;
+            alen = vlen;
+        } else if (!header_skipped(line, nlen, value, vlen)) {
+            bytes_byte(&headers, 0x00);
+            hpack_lower(&headers, line, nlen);
+            hpack_string(&headers, value, vlen);
+        }
+    }
+
+    size_t mlen = method_end - req, plen = path_end - path;
+    if (mlen == 3 && !memcmp(req, "GET", 3)) {
+        bytes_byte(&block, 0x82);
+    } else if (mlen == 4 && !memcmp(req, "POST", 4)) {
+        bytes_byte(&block, 0x83);
+    } else {
+        bytes_byte(&block, 0x02);
+        hpack_string(&block, req, mlen);
+    }
+    bytes_byte(&block, tls ? 0x87 : 0x86);
+    if (plen == 1 && *path == '/') {
+        bytes_byte(&block, 0x84);
+    } else {
+        bytes_byte(&block, 0x04);
+        hpack_string(&block, path, plen);
+    }
+    bytes_byte(&block, 0x01);
+    hpack_string(&block, authority, alen);
+    if (headers.len) bytes_append(&block, headers.data, headers.len);
+    zfree(headers.data);
+
+    r->block   = block.data;
+    r->blen    = block.len;
+    r->body    = eol + 2;
+    r->bodylen = end - r->body;
+
+    // bodies are sent in one go and must fit the initial stream window
+    if (r->bodylen > HTTP2_DEFAULT_WINDOW) {
+        http2_request_free(r);
+        return false;
+    }
+    return true;
+
+  error:
+    zfree(headers.data);
+    return false;
+}
+
+void http2_request_free(http2_request *r) {
+    zfree(r->block);
+    memset(r, 0, sizeof(*r));
+}
+
+static void out_append(http2 *h, const void *data, size_t len) {
+    bytes b = { h->out, h->outlen, h->outcap };
+    bytes_append(&b, data, len);
+    h->out    = b.data;
+    h->outlen = b.len;
+    h->outcap = b.cap;
+}
+
+static void out_frame(http2 *h, uint32_t len, uint8_t type, uint8_t flags, uint32_t id) {
+    uint8_t head[9] = {
+        len >> 16, len >> 8, len, type, flags,
+        id >> 24, id >> 16, id >> 8, id
+    };
+    out_append(h, head, sizeof(head));
+}
+
+static void out_window_update(http2 *h, uint32_t id, uint32_t increment) {
+    uint8_t inc[4] = { increment >> 24, increment >> 16, increment >> 8, increment };
+    out_frame(h, 4, HTTP2_WINDOW_UPDATE, 0, id);
+    out_append(h, inc, 4);
+}
+
+static void out_setting(http2 *h, uint16_t id, uint32_t value) {
+    uint8_t s[6] = { id >> 8, id, value >> 24, value >> 16, value >> 8, value };
+    out_append(h, s, sizeof(s));
+}
+
+// reset the state for a new connection and queue the connection preface,
+// the output buffer is kept for reuse
+void http2_init(http2 *h, http2_stream *slots, uint32_t streams) {
+    uint8_t *out  = h->out;
+    size_t outcap = h->outcap;
+
+    memset(h, 0, sizeof(*h));
+    memset(slots, 0, streams * sizeof(http2_stream));
+    h->out     = out;
+    h->outcap  = outcap;
+    h->slots   = slots;
+    h->streams = streams;
+    // until the server announces a limit assume the recommended minimum
+    h->limit   = HTTP2_STREAMS;
+    h->next    = 1;
+    h->window  = HTTP2_DEFAULT_WINDOW;
+    h->frame   = HTTP2_DEFAULT_FRAME;
+    h->credit  = HTTP2_DEFAULT_WINDOW;
+
+    out_append(h, HTTP2_PREFACE, sizeof(HTTP2_PREFACE) - 1);
+    out_frame(h, 18, HTTP2_SETTINGS, 0, 0);
+    out_setting(h, HTTP2_HEADER_TABLE_SIZE, 0);
+    out_setting(h, HTTP2_ENABLE_PUSH, 0);
+    out_setting(h, HTTP2_INITIAL_WINDOW_SIZE, HTTP2_WINDOW);
+    out_window_update(h, 0, HTTP2_WINDOW - HTTP2_DEFAULT_WINDOW);
+}
+
+void http2_sent(http2 *h, size_t n) {
+    h->sent += n;
+    if (h->sent == h->outlen) {
+        h->sent   = 0;
+        h->outlen = 0;
+    }
+}
+
+bool http2_can_submit(http2 *h) {
+    uint32_t limit = h->limit < h->streams ? h->limit : h->streams;
+    return !h->goaway && h->active < limit && h->next <= HTTP2_MAX_STREAM_ID;
+}
+
+// open a stream and queue the request, bodies are only sent when they
+// fit into both flow control windows
+bool http2_submit(http2 *h, http2_request *r, uint64_t now) {
+    http2_stream *s = h->slots;
+
+    if (!http2_can_submit(h)) return false;
+    if (r->bodylen > h->window || (int64_t) r->bodylen > h->credit) return false;
+
+    while (s->id) s++;
+    s->id     = h->next;
+    s->status = 0;
+    s->start  = now;
+    s->first  = 0;
+    s->recv   = 0;
+
+    h->next += 2;
+    h->active++;
+    h->opened++;
+
+    size_t off = 0;
+    do {
+        size_t n = r->blen - off > h->frame ? h->frame : r->blen - off;
+        uint8_t type  = off ? HTTP2_CONTINUATION : HTTP2_HEADERS;
+        uint8_t flags = off + n == r->blen ? HTTP2_END_HEADERS : 0;
+        if (!off && !r->bodylen) flags |= HTTP2_END_STREAM;
+        out_frame(h, n, type, flags, s->id);
+        out_append(h, r->block + off, n);
+        off += n;
+    } while (off < r->blen);
+
+    for (off = 0; off < r->bodylen; ) {
+        size_t n = r->bodylen - off > h->frame ? h->frame : r->bodylen - off;
+        uint8_t flags = off + n == r->bodylen ? HTTP2_END_STREAM : 0;
+        out_frame(h, n, HTTP2_DATA, flags, s->id);
+        out_append(h, r->body + off, n);
+        off += n;
+    }
+    h->credit -= r->bodylen;
+
+    return true;
+}
+
+static http2_stream *find_stream(http2 *h, uint32_t id) {
+    if (!id) return NULL;
+    for (uint32_t i = 0; i < h->streams; i++) {
+        if (h->slots[i].id == id) return &h->slots[i];
+    }
+    return NULL;
+}
+
+static void finish_stream(http2 *h, http2_stream *s, bool reset, http2_stream_func fn, void *data) {
+    h->active--;
+    fn(data, s, reset);
+    s->id = 0;
+}
+
+static bool handle_frame(http2 *h, uint64_t now, http2_stream_func fn, void *data) {
+    http2_stream *s = find_stream(h, h->stream);
+    uint8_t *p = h->payload;
+
+    switch (h->type) {
+        case HTTP2_DATA:
+            h->recv += h->length;
+            if (h->recv >= HTTP2_WINDOW / 2) {
+                out_window_update(h, 0, h->recv);
+                h->recv = 0;
+            }
+            if (!s) break;
+            if (h->flags & HTTP2_END_STREAM) {
+                finish_stream(h, s, false, fn, data);
+            } else if ((s->recv += h->length) >= HTTP2_WINDOW / 2) {
+                out_window_update(h, s->id, s->recv);
+                s->recv = 0;
+            }
+            break;
+        case HTTP2_HEADERS:
+            if (!s) break;
+            if (s->status < 200) {
+                size_t off = 0;
+                if (h->flags & HTTP2_PADDED) off += 1;
+                if (h->flags & HTTP2_PRIORITY) off += 5;
+                s->status = off < h->keep ? hpack_status(p + off, h->keep - off) : 0;
+            }
+            if (!s->first) s->first = now;
+            if (h->flags & HTTP2_END_STREAM) finish_stream(h, s, false, fn, data);
+            break;
+        case HTTP2_RST_STREAM:
+            if (s) finish_stream(h, s, true, fn, data);
+            break;
+        case HTTP2_SETTINGS:
+            if (h->flags & HTTP2_ACK) break;
+            if (h->stream || h->length % 6) return false;
+            // the first SETTINGS replaces the assumed stream limit
+            if (!h->settings) h->limit = UINT32_MAX;
+            h->settings = true;
+            for (uint32_t i = 0; i + 6 <= h->keep; i += 6) {
+                uint16_t id = p[i] << 8 | p[i + 1];
+                uint32_t value = read32(p + i + 2);
+                switch (id) {
+                    case HTTP2_MAX_CONCURRENT_STREAMS: h->limit  = value; break;
+                    case HTTP2_INITIAL_WINDOW_SIZE:
+                        if (value > HTTP2_MAX_WINDOW) return false;
+                        h->window = value;
+                        break;
+                    case HTTP2_MAX_FRAME_SIZE:
+                        if (value < HTTP2_DEFAULT_FRAME || value > HTTP2_MAX_FRAME) return false;
+                        h->frame = value;
+                        break;
+                }
+            }
+            out_frame(h, 0, HTTP2_SETTINGS, HTTP2_ACK, 0);
+            break;
+        case HTTP2_PUSH_PROMISE:
+            return false;
+        case HTTP2_PING:
+            if (h->flags & HTTP2_ACK) break;
+            if (h->length != 8) return false;
+            out_frame(h, 8, HTTP2_PING, HTTP2_ACK, 0);
+            out_append(h, p, 8);
+            break;
+        case HTTP2_GOAWAY: {
+            if (h->keep < 8) return false;
+            uint32_t last = read32(p) & HTTP2_MAX_STREAM_ID;
+            h->goaway = true;
+            for (uint32_t i = 0; i < h->streams; i++) {
+                s = &h->slots[i];
+                if (s->id > last) finish_stream(h, s, true, fn, data);
+            }
+            break;
+        }
+        case HTTP2_WINDOW_UPDATE:
+            if (h->keep < 4) return false;
+            if (!h->stream) h->credit += read32(p) & HTTP2_MAX_STREAM_ID;
+            break;
+    }
+
+    return true;
+}
+
+// feed received bytes through the frame parser, only the first bytes of
+// a frame's payload are kept, which is all that is needed of any frame
+bool http2_parse(http2 *h, uint8_t *buf, size_t n, uint64_t now, http2_stream_func fn, void *data) {
+    while (n > 0) {
+        if (h->have < sizeof(h->head)) {
+            size_t len = sizeof(h->head) - h->have;
+            if (len > n) len = n;
+            memcpy(h->head + h->have, buf, len);
+            h->have += len;
+            buf += len;
+            n   -= len;
+            if (h->have < sizeof(h->head)) break;
+
+            h->length = h->head[0] << 16 | h->head[1] << 8 | h->head[2];
+            h->type   = h->head[3];
+            h->flags  = h->head[4];
+            h->stream = read32(h->head + 5) & HTTP2_MAX_STREAM_ID;
+            if (h->length > HTTP2_DEFAULT_FRAME) return false;
+
+            h->keep = h->type == HTTP2_DATA ? 0 : h->length;
+            if (h->keep > HTTP2_KEEP) h->keep = HTTP2_KEEP;
+            h->skip = h->length - h->keep;
+            h->got  = 0;
+        }
+
+        if (h->got < h->keep) {
+            size_t len = h->keep - h->got;
+            if (len > n) len = n;
+            memcpy(h->payload + h->got, buf, len);
+            h->got += len;
+            buf += len;
+            n   -= len;
+        }
+
+        if (h->got == h->keep && h->skip) {
+            size_t len = h->skip > n ? n : h->skip;
+            h->skip -= len;
+            buf += len;
+            n   -= len;
+        }
+
+        if (h->got == h->keep && !h->skip) {
+            h->have = 0;
+            if (!handle_frame(h, now, fn, data)) return false;
+        }
+    }
+
+    return true;
+}
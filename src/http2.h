@@ -0,0 +1,69 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTP2_KEEP    128
+#define HTTP2_STREAMS 100
+#define HTTP2_WINDOW  (1 << 30)
+
+// a request converted once to an HPACK header block that only uses the
+// static table, so it can be sent on any stream of any connection
+typedef struct {
+    uint8_t *block;
+    size_t   blen;
+    char    *body;
+    size_t   bodylen;
+} http2_request;
+
+typedef struct {
+    uint32_t id;
+    uint32_t status;
+    uint64_t start;
+    uint64_t first;
+    uint64_t recv;
+} http2_stream;
+
+typedef struct {
+    uint8_t  head[9];
+    uint8_t  have;
+    uint8_t  type;
+    uint8_t  flags;
+    uint32_t stream;
+    uint32_t length;
+    uint32_t keep;
+    uint32_t got;
+    uint32_t skip;
+    uint8_t  payload[HTTP2_KEEP];
+    uint8_t *out;
+    size_t   outlen;
+    size_t   outcap;
+    size_t   sent;
+    uint32_t next;
+    uint32_t active;
+    uint32_t limit;
+    uint32_t streams;
+    uint32_t window;
+    uint32_t frame;
+    int64_t  credit;
+    uint64_t recv;
+    uint64_t opened;
+    bool     goaway;
+    bool     settings;
+    http2_stream *slots;
+} http2;
+
+typedef void (*http2_stream_func)(void *, http2_stream *, bool);
+
+bool http2_request_encode(http2_request *, char *, size_t, char *, bool);
+void http2_request_free(http2_request *);
+
+void http2_init(http2 *, http2_stream *, uint32_t);
+bool http2_submit(http2 *, http2_request *, uint64_t);
+bool http2_can_submit(http2 *);
+bool http2_parse(http2 *, uint8_t *, size_t, uint64_t, http2_stream_func, void *);
+void http2_sent(http2 *, size_t);
+
+#endif /* HTTP2_H */
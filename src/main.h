@@ -5,7 +5,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <math.h>
+#include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <stdarg.h>
@@ -21,11 +23,12 @@
 
 #include "ssl.h"
 #include "aprintf.h"
+#include "hlog.h"
 #include "stats.h"
 #include "units.h"
 #include "zmalloc.h"
 
-typedef bool (*response_complete_func)(connection *c, size_t n);
+typedef bool (*response_complete_func)(connection *c, char *buf, size_t n);
 
 struct config;
 
@@ -34,13 +37,24 @@ static int connect_socket(thread *, connection *);
 static int reconnect_socket(thread *, connection *);
 
 static int record_rate(aeEventLoop *, long long, void *);
+static int check_timeout(aeEventLoop *, long long, void *);
+static void record_interval(thread *, stats *, uint64_t, uint64_t);
 
 static void socket_connected(aeEventLoop *, int, void *, int);
+static void session_readable(aeEventLoop *, int, void *, int);
+static int session_expired(aeEventLoop *, long long, void *);
 static void socket_writeable(aeEventLoop *, int, void *, int);
 static void socket_readable(aeEventLoop *, int, void *, int);
+static void socket_sent(aeEventLoop *, int, void *, long);
+static void socket_received(aeEventLoop *, int, void *, char *, long);
+static void socket_wait_writable(aeEventLoop *, connection *, bool);
 
-bool stream_response_complete(connection *, size_t);
-bool http_response_complete(connection *, size_t);
+bool stream_response_complete(connection *, char *, size_t);
+bool http_response_complete(connection *, char *, size_t);
+bool http2_response_complete(connection *, char *, size_t);
+static void http2_stream_complete(void *, http2_stream *, bool);
+static void http2_writeable(aeEventLoop *, connection *);
+static int message_begin(http_parser *);
 static int message_complete(http_parser *);
 static int header_field(http_parser *, const char *, size_t);
 static int header_value(http_parser *, const char *, size_t);
@@ -48,11 +62,29 @@ static int response_body(http_parser *, const char *, size_t);
 
 static uint64_t time_us();
 
+static connection_cold *cold(connection *);
+static http2 *h2(connection *);
+static void phases_alloc(phases *, uint64_t);
+static void phases_merge(phases *, phases *);
+
+static int merge_logs(int, char **);
+
+static int parse_sources(struct config *, char *);
+static int parse_tls_version(struct config *, char *);
+static int bind_source(thread *, int);
+static int parse_percentiles(struct config *, char *);
 static int parse_args(struct config *, char **, struct http_parser_url *, char **, int, char **);
 static char *copy_url_part(char *, struct http_parser_url *, enum http_parser_url_fields);
 
 static void print_stats_header();
 static void print_stats(char *, stats *, char *(*)(long double));
 static void print_stats_latency(stats *);
+static void print_stats_phases(phases *);
+static void print_stats_classes(stats **);
+static void print_status(uint64_t *);
+static void print_stats_spectrum(stats *);
+static void print_json(char *, uint64_t, uint64_t, uint64_t, uint64_t, errors *);
+static void print_interval_header();
+static void print_interval(uint64_t, uint64_t, uint64_t, errors *, stats *);
 
 #endif /* MAIN_H */
@@ -2,7 +2,6 @@
 
 #include <errno.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
 
 #include "net.h"
 
@@ -14,10 +13,16 @@ status sock_close(connection *c) {
     return OK;
 }
 
-status sock_read(connection *c, size_t *n) {
-    ssize_t r = read(c->fd, c->buf, sizeof(c->buf));
+status sock_read(connection *c, char *buf, size_t len, size_t *n) {
+    ssize_t r;
+    if ((r = read(c->fd, buf, len)) == -1) {
+        switch (errno) {
+            case EAGAIN: return RETRY;
+            default:     return ERROR;
+        }
+    }
     *n = (size_t) r;
-    return r >= 0 ? OK : ERROR;
+    return OK;
 }
 
 status sock_write(connection *c, char *buf, size_t len, size_t *n) {
@@ -31,9 +36,3 @@ status sock_write(connection *c, char *buf, size_t len, size_t *n) {
     *n = (size_t) r;
     return OK;
 }
-
-size_t sock_readable(connection *c) {
-    int n, rc;
-    rc = ioctl(c->fd, FIONREAD, &n);
-    return rc == -1 ? 0 : n;
-}
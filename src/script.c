@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/un.h>
 #include "script.h"
 #include "http_parser.h"
 #include "zmalloc.h"
@@ -203,11 +204,17 @@ void script_response(lua_State *L, int status, buffer *headers, buffer *body) {
     buffer_reset(body);
 }
 
-bool script_stream_response(lua_State *L, const char *data, size_t n){
+// stream_response() returns whether the data was fine or a status code
+bool script_stream_response(lua_State *L, const char *data, size_t n, int *status) {
     lua_getglobal(L, "stream_response");
     lua_pushlstring(L, data, n);
     lua_call(L, 1, 1);
     bool ok = lua_toboolean(L, -1);
+    *status = 0;
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        *status = lua_tointeger(L, -1);
+        ok = *status < 400;
+    }
     lua_pop(L, 1);
     return ok;
 }
@@ -275,6 +282,16 @@ void script_errors(lua_State *L, errors *errors) {
     lua_setfield(L, 1, "errors");
 }
 
+void script_status(lua_State *L, uint64_t *status) {
+    lua_newtable(L);
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (!status[i]) continue;
+        lua_pushinteger(L, status[i]);
+        lua_rawseti(L, -2, STATUS_MIN + i);
+    }
+    lua_setfield(L, 1, "status");
+}
+
 void script_push_stats(lua_State *L, stats *s) {
     stats **ptr = (stats **) lua_newuserdata(L, sizeof(stats **));
     *ptr = s;
@@ -359,6 +376,12 @@ static int script_addr_tostring(lua_State *L) {
     char host[NI_MAXHOST];
     char service[NI_MAXSERV];
 
+    if (addr->ai_family == AF_UNIX) {
+        struct sockaddr_un *sun = (struct sockaddr_un *) addr->ai_addr;
+        lua_pushfstring(L, "unix:%s", sun->sun_path);
+        return 1;
+    }
+
     int flags = NI_NUMERICHOST | NI_NUMERICSERV;
     int rc = getnameinfo(addr->ai_addr, addr->ai_addrlen, host, NI_MAXHOST, service, NI_MAXSERV, flags);
     if (rc != 0) {
@@ -389,6 +412,40 @@ static int script_stats_percentile(lua_State *L) {
     return 1;
 }
 
+static int script_stats_percentiles(lua_State *L) {
+    stats *s = checkstats(L);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    size_t n = lua_objlen(L, 2);
+
+    // check before allocating, a Lua error would leak the buffers
+    for (size_t i = 0; i < n; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        luaL_argcheck(L, lua_isnumber(L, -1), 2, "percentiles must be numbers");
+        lua_pop(L, 1);
+    }
+
+    long double *p = zmalloc(MAX(n, 1) * sizeof(long double));
+    uint64_t *values = zmalloc(MAX(n, 1) * sizeof(uint64_t));
+
+    for (size_t i = 0; i < n; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        p[i] = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+
+    stats_percentiles(s, p, values, n);
+
+    lua_createtable(L, n, 0);
+    for (size_t i = 0; i < n; i++) {
+        lua_pushnumber(L, values[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    zfree(p);
+    zfree(values);
+    return 1;
+}
+
 static int script_stats_call(lua_State *L) {
     stats *s = checkstats(L);
     uint64_t index = lua_tonumber(L, 2);
@@ -408,6 +465,9 @@ static int script_stats_index(lua_State *L) {
     if (!strcmp("percentile", method)) {
         lua_pushcfunction(L, script_stats_percentile);
     }
+    if (!strcmp("percentiles", method)) {
+        lua_pushcfunction(L, script_stats_percentiles);
+    }
     return 1;
 }
 
@@ -481,6 +541,27 @@ static int script_wrk_lookup(lua_State *L) {
     const char *host    = lua_tostring(L, -2);
     const char *service = lua_tostring(L, -1);
 
+    if (service && !strcmp(service, "unix")) {
+        struct sockaddr_un sun = { .sun_family = AF_UNIX };
+        struct addrinfo addr = {
+            .ai_family   = AF_UNIX,
+            .ai_socktype = SOCK_STREAM,
+            .ai_addr     = (struct sockaddr *) &sun,
+            .ai_addrlen  = sizeof(sun)
+        };
+
+        if (strlen(host) >= sizeof(sun.sun_path)) {
+            fprintf(stderr, "unable to resolve %s: path too long\n", host);
+            exit(1);
+        }
+        strcpy(sun.sun_path, host);
+
+        lua_newtable(L);
+        script_addr_clone(L, &addr);
+        lua_rawseti(L, -2, 1);
+        return 1;
+    }
+
     if ((rc = getaddrinfo(host, service, &hints, &addrs)) != 0) {
         const char *msg = gai_strerror(rc);
         fprintf(stderr, "unable to resolve %s:%s %s\n", host, service, msg);
@@ -19,7 +19,7 @@ void script_init(lua_State *, thread *, int, char **);
 uint64_t script_delay(lua_State *);
 void script_request(lua_State *, char **, size_t *);
 void script_response(lua_State *, int, buffer *, buffer *);
-bool script_stream_response(lua_State *, const char *, size_t);
+bool script_stream_response(lua_State *, const char *, size_t, int *);
 size_t script_verify_request(lua_State *L);
 
 bool script_is_static(lua_State *);
@@ -29,6 +29,7 @@ bool script_has_delay(lua_State *L);
 bool script_has_done(lua_State *L);
 void script_summary(lua_State *, uint64_t, uint64_t, uint64_t);
 void script_errors(lua_State *, errors *);
+void script_status(lua_State *, uint64_t *);
 
 void script_copy_value(lua_State *, lua_State *, int);
 int script_parse_url(char *, struct http_parser_url *);
@@ -1,25 +1,182 @@
 // Copyright (C) 2013 - Will Glozer.  All rights reserved.
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <openssl/evp.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
 #include "ssl.h"
+#include "aprintf.h"
 
-SSL_CTX *ssl_init() {
+// OpenSSL allocations are prefixed with their size so the heap used by
+// TLS state can be reported, the prefix keeps the result max aligned
+#define SSL_MEM_PREFIX 16
+
+// each thread counts what it allocates and frees in its own cache line,
+// memory freed by another thread than allocated it only evens out in the
+// sum over all threads
+typedef struct ssl_counter {
+    int64_t used;
+    struct ssl_counter *next;
+    char pad[48];
+} ssl_counter;
+
+static ssl_counter *ssl_counters = NULL;
+static pthread_mutex_t ssl_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread ssl_counter *ssl_thread_counter = NULL;
+
+static void ssl_count(int64_t n) {
+    ssl_counter *c = ssl_thread_counter;
+    if (!c) {
+        if (posix_memalign((void **) &c, sizeof(*c), sizeof(*c))) abort();
+        memset(c, 0, sizeof(*c));
+        pthread_mutex_lock(&ssl_counters_lock);
+        c->next = ssl_counters;
+        __atomic_store_n(&ssl_counters, c, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&ssl_counters_lock);
+        ssl_thread_counter = c;
+    }
+    __atomic_store_n(&c->used, c->used + n, __ATOMIC_RELAXED);
+}
+
+static void *ssl_malloc(size_t n, const char *file, int line) {
+    size_t *p = malloc(n + SSL_MEM_PREFIX);
+    if (!p) return NULL;
+    *p = n;
+    ssl_count(n);
+    return (char *) p + SSL_MEM_PREFIX;
+}
+
+static void ssl_free(void *ptr, const char *file, int line) {
+    if (!ptr) return;
+    size_t *p = (size_t *) ((char *) ptr - SSL_MEM_PREFIX);
+    ssl_count(-(int64_t) *p);
+    free(p);
+}
+
+static void *ssl_realloc(void *ptr, size_t n, const char *file, int line) {
+    if (!ptr) return ssl_malloc(n, file, line);
+    if (!n) {
+        ssl_free(ptr, file, line);
+        return NULL;
+    }
+    size_t *p = (size_t *) ((char *) ptr - SSL_MEM_PREFIX);
+    size_t old = *p;
+    if (!(p = realloc(p, n + SSL_MEM_PREFIX))) return NULL;
+    *p = n;
+    ssl_count((int64_t) n - (int64_t) old);
+    return (char *) p + SSL_MEM_PREFIX;
+}
+
+// must be called before anything else in OpenSSL allocates
+bool ssl_track_memory() {
+    return CRYPTO_set_mem_functions(ssl_malloc, ssl_realloc, ssl_free);
+}
+
+size_t ssl_used_memory() {
+    ssl_counter *c = __atomic_load_n(&ssl_counters, __ATOMIC_ACQUIRE);
+    int64_t used = 0;
+    for (; c; c = c->next) {
+        used += __atomic_load_n(&c->used, __ATOMIC_RELAXED);
+    }
+    return used > 0 ? (size_t) used : 0;
+}
+
+// a copy of the session a connection offered last, OpenSSL won't resume
+// a TLS 1.3 session again once it has been used
+static int ssl_offered = -1;
+
+static void ssl_free_offered(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp) {
+    SSL_SESSION_free(ptr);
+}
+
+// hold the newest session of a connection until it is reopened, TLS 1.3
+// tickets are single use so each one is only offered once
+static int ssl_new_session(SSL *ssl, SSL_SESSION *session) {
+    SSL_SESSION *last = SSL_get_app_data(ssl);
+    SSL_set_app_data(ssl, session);
+    if (last) SSL_SESSION_free(last);
+    return 1;
+}
+
+// split a list of ciphers at ':' or ',' into TLS 1.3 suites, which are
+// all named TLS_*, and TLS 1.2 and older cipher strings
+static bool ssl_set_ciphers(SSL_CTX *ctx, char *list) {
+    char *copy = strdup(list), *suites = NULL, *ciphers = NULL;
+    char *save, *name;
+    bool ok = true;
+
+    for (name = strtok_r(copy, ":,", &save); name; name = strtok_r(NULL, ":,", &save)) {
+        char **dst = strncmp(name, "TLS_", 4) ? &ciphers : &suites;
+        aprintf(dst, "%s%s", *dst ? ":" : "", name);
+    }
+
+    if (ciphers) ok = ok && SSL_CTX_set_cipher_list(ctx, ciphers);
+    if (suites)  ok = ok && SSL_CTX_set_ciphersuites(ctx, suites);
+
+    free(copy);
+    free(ciphers);
+    free(suites);
+    return ok;
+}
+
+// convert a comma separated list of protocols to the ALPN wire format
+static bool ssl_set_alpn(SSL_CTX *ctx, char *list) {
+    unsigned char wire[256];
+    size_t len = 0;
+    char *copy = strdup(list), *save, *name;
+
+    for (name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        size_t n = strlen(name);
+        if (n > 255 || len + n + 1 > sizeof(wire)) break;
+        wire[len++] = (unsigned char) n;
+        memcpy(&wire[len], name, n);
+        len += n;
+    }
+
+    bool ok = !name && len && !SSL_CTX_set_alpn_protos(ctx, wire, len);
+    free(copy);
+    return ok;
+}
+
+SSL_CTX *ssl_init(ssl_config *cfg) {
     SSL_CTX *ctx = NULL;
 
     SSL_load_error_strings();
     SSL_library_init();
     OpenSSL_add_all_algorithms();
 
+    if (ssl_offered < 0) {
+        ssl_offered = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_free_offered);
+    }
+
     if ((ctx = SSL_CTX_new(SSLv23_client_method()))) {
         SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
         SSL_CTX_set_verify_depth(ctx, 0);
-        SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
-        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+        SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY | SSL_MODE_RELEASE_BUFFERS);
+        if (cfg->resume) {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            SSL_CTX_sess_set_new_cb(ctx, ssl_new_session);
+        } else {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+            SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        }
+#ifdef SSL_OP_ENABLE_KTLS
+        if (cfg->ktls) SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+        if ((cfg->version && (!SSL_CTX_set_min_proto_version(ctx, cfg->version) ||
+                              !SSL_CTX_set_max_proto_version(ctx, cfg->version))) ||
+            (cfg->ciphers && !ssl_set_ciphers(ctx, cfg->ciphers)) ||
+            (cfg->groups  && !SSL_CTX_set1_groups_list(ctx, cfg->groups)) ||
+            (cfg->alpn    && !ssl_set_alpn(ctx, cfg->alpn))) {
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
     }
 
     return ctx;
@@ -40,14 +197,58 @@ status ssl_connect(connection *c, char *host) {
 }
 
 status ssl_close(connection *c) {
+    SSL_SESSION *session = SSL_get_app_data(c->ssl);
+    SSL_SESSION *offered = SSL_get_ex_data(c->ssl, ssl_offered);
+    long mode = SSL_CTX_get_session_cache_mode(SSL_get_SSL_CTX(c->ssl));
+    bool tls13 = SSL_session_reused(c->ssl) && SSL_version(c->ssl) >= TLS1_3_VERSION;
+
     SSL_shutdown(c->ssl);
     SSL_clear(c->ssl);
+
+    // SSL_clear keeps the session it just used, which is what a resumed
+    // TLS 1.2 handshake without a new session should offer next, while
+    // TLS 1.3 offers a copy of the last ticket if there is no new one
+    if (session) {
+        SSL_SESSION_free(offered);
+        SSL_set_ex_data(c->ssl, ssl_offered, SSL_SESSION_dup(session));
+    } else if (tls13 && offered) {
+        session = SSL_SESSION_dup(offered);
+    }
+
+    if (session || mode == SSL_SESS_CACHE_OFF) {
+        SSL_set_session(c->ssl, session);
+        SSL_set_app_data(c->ssl, NULL);
+        SSL_SESSION_free(session);
+    }
     return OK;
 }
 
-status ssl_read(connection *c, size_t *n) {
+bool ssl_resumed(connection *c) {
+    return SSL_session_reused(c->ssl);
+}
+
+// true once there is a session to offer when reopening the connection,
+// with TLS 1.3 that is only after a session ticket has been read
+bool ssl_resumable(connection *c) {
+    if (SSL_get_app_data(c->ssl)) return true;
+    return SSL_session_reused(c->ssl) && SSL_version(c->ssl) < TLS1_3_VERSION;
+}
+
+status ssl_read(connection *c, char *buf, size_t len, size_t *n) {
     int r;
-    if ((r = SSL_read(c->ssl, c->buf, sizeof(c->buf))) <= 0) {
+    if (c->ktls) {
+        // the kernel decrypts application data, anything else such as
+        // a session ticket fails with EIO and is left to SSL_read
+        ssize_t k = read(c->fd, buf, len);
+        if (k > 0) {
+            *n = (size_t) k;
+            return OK;
+        }
+        if (k == 0) return ERROR;
+        if (errno == EAGAIN) return RETRY;
+        if (errno != EIO) return ERROR;
+    }
+    if ((r = SSL_read(c->ssl, buf, len)) <= 0) {
         switch (SSL_get_error(c->ssl, r)) {
             case SSL_ERROR_WANT_READ:  return RETRY;
             case SSL_ERROR_WANT_WRITE: return RETRY;
@@ -71,6 +272,43 @@ status ssl_write(connection *c, char *buf, size_t len, size_t *n) {
     return OK;
 }
 
-size_t ssl_readable(connection *c) {
-    return SSL_pending(c->ssl);
+// whether the kernel took over decryption or encryption of the records
+// after the handshake, which needs the tls module and a supported cipher
+bool ssl_ktls_recv(connection *c) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    return BIO_get_ktls_recv(SSL_get_rbio(c->ssl));
+#else
+    return false;
+#endif
+}
+
+bool ssl_ktls_send(connection *c) {
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    return BIO_get_ktls_send(SSL_get_wbio(c->ssl));
+#else
+    return false;
+#endif
+}
+
+bool ssl_selected(connection *c, char *proto) {
+    const unsigned char *selected;
+    unsigned int len;
+    SSL_get0_alpn_selected(c->ssl, &selected, &len);
+    return len == strlen(proto) && !memcmp(selected, proto, len);
+}
+
+// the negotiated protocol version, cipher, key exchange group and ALPN
+char *ssl_describe(connection *c) {
+    const unsigned char *proto;
+    unsigned int len;
+    char *desc = NULL;
+
+    aprintf(&desc, "%s %s", SSL_get_version(c->ssl), SSL_get_cipher_name(c->ssl));
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    int group = SSL_get_negotiated_group(c->ssl);
+    if (group) aprintf(&desc, " %s", SSL_group_to_name(c->ssl, group));
+#endif
+    SSL_get0_alpn_selected(c->ssl, &proto, &len);
+    if (len) aprintf(&desc, " %.*s", (int) len, proto);
+    return desc;
 }
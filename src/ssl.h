@@ -3,12 +3,28 @@
 
 #include "net.h"
 
-SSL_CTX *ssl_init();
+typedef struct {
+    bool resume;
+    bool ktls;
+    int version;
+    char *ciphers;
+    char *groups;
+    char *alpn;
+} ssl_config;
+
+SSL_CTX *ssl_init(ssl_config *);
+bool ssl_track_memory();
+size_t ssl_used_memory();
 
 status ssl_connect(connection *, char *);
 status ssl_close(connection *);
-status ssl_read(connection *, size_t *);
+status ssl_read(connection *, char *, size_t, size_t *);
 status ssl_write(connection *, char *, size_t, size_t *);
-size_t ssl_readable(connection *);
+bool ssl_resumed(connection *);
+bool ssl_resumable(connection *);
+bool ssl_ktls_recv(connection *);
+bool ssl_ktls_send(connection *);
+bool ssl_selected(connection *, char *);
+char *ssl_describe(connection *);
 
 #endif /* SSL_H */
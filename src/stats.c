@@ -2,41 +2,183 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "stats.h"
+#include "bigendian.h"
 #include "zmalloc.h"
 
-stats *stats_alloc(uint64_t max) {
-    uint64_t limit = max + 1;
-    stats *s = zcalloc(sizeof(stats) + sizeof(uint64_t) * limit);
-    s->limit = limit;
-    s->min   = UINT64_MAX;
+static int32_t stats_index(stats *stats, uint64_t n) {
+    int32_t pow2ceiling = 64 - __builtin_clzll(n | stats->mask);
+    int32_t bucket = pow2ceiling - (stats->magnitude + 1);
+    int32_t sub    = n >> bucket;
+    return ((bucket + 1) << stats->magnitude) + (sub - stats->half);
+}
+
+static int32_t stats_bucket(stats *stats, int32_t i) {
+    return MAX((i >> stats->magnitude) - 1, 0);
+}
+
+static uint64_t stats_value(stats *stats, int32_t i) {
+    int32_t bucket = (i >> stats->magnitude) - 1;
+    int32_t sub    = (i & (stats->half - 1)) + stats->half;
+    if (bucket < 0) {
+        sub   -= stats->half;
+        bucket = 0;
+    }
+    return (uint64_t) sub << bucket;
+}
+
+static uint64_t stats_median(stats *stats, int32_t i) {
+    uint64_t width = UINT64_C(1) << stats_bucket(stats, i);
+    return stats_value(stats, i) + (width >> 1);
+}
+
+static uint64_t stats_highest(stats *stats, int32_t i) {
+    uint64_t width = UINT64_C(1) << stats_bucket(stats, i);
+    return MIN(stats_value(stats, i) + width - 1, stats->max);
+}
+
+static void stats_build(stats *stats) {
+    if (stats->slots && stats->indexed == stats->count) return;
+
+    uint64_t entries = 0, total = 0;
+    int32_t first = stats_index(stats, stats->min);
+    int32_t last  = stats_index(stats, stats->max);
+
+    for (int32_t i = first; i <= last; i++) {
+        if (stats->data[i]) entries++;
+    }
+
+    stats->slots  = zrealloc(stats->slots,  MAX(entries, 1) * sizeof(int32_t));
+    stats->totals = zrealloc(stats->totals, MAX(entries, 1) * sizeof(uint64_t));
+
+    for (int32_t i = first, n = 0; i <= last; i++) {
+        if (!stats->data[i]) continue;
+        total += stats->data[i];
+        stats->slots[n]  = i;
+        stats->totals[n] = total;
+        n++;
+    }
+
+    stats->entries = entries;
+    stats->indexed = stats->count;
+}
+
+static uint64_t stats_rank(stats *stats, long double p) {
+    uint64_t rank = round((p / 100.0) * stats->count + 0.5);
+    rank = MIN(MAX(rank, 1), stats->count);
+
+    uint64_t lo = 0, hi = stats->entries;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (stats->totals[mid] < rank) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == stats->entries) return 0;
+    return stats_highest(stats, stats->slots[lo]);
+}
+
+stats *stats_alloc(uint64_t max, int digits) {
+    digits = MIN(MAX(digits, 1), 5);
+
+    uint64_t single = 2;
+    for (int i = 0; i < digits; i++) single *= 10;
+
+    int32_t magnitude = 0;
+    while ((UINT64_C(1) << magnitude) < single) magnitude++;
+    magnitude = MAX(magnitude, 1) - 1;
+
+    uint64_t count = UINT64_C(1) << (magnitude + 1);
+    uint64_t smallest = count;
+    int32_t buckets = 1;
+    while (smallest <= max) {
+        if (smallest > INT64_MAX / 2) {
+            buckets++;
+            break;
+        }
+        smallest <<= 1;
+        buckets++;
+    }
+
+    int32_t length = (buckets + 1) * (count / 2);
+    stats *s = zcalloc(sizeof(stats) + sizeof(uint64_t) * length);
+    s->limit     = max;
+    s->min       = UINT64_MAX;
+    s->digits    = digits;
+    s->magnitude = magnitude;
+    s->half      = count / 2;
+    s->buckets   = buckets;
+    s->mask      = count - 1;
+    s->length    = length;
     return s;
 }
 
 void stats_free(stats *stats) {
+    zfree(stats->slots);
+    zfree(stats->totals);
     zfree(stats);
 }
 
 int stats_record(stats *stats, uint64_t n) {
-    if (n >= stats->limit) return 0;
-    __sync_fetch_and_add(&stats->data[n], 1);
-    __sync_fetch_and_add(&stats->count, 1);
-    uint64_t min = stats->min;
-    uint64_t max = stats->max;
-    while (n < min) min = __sync_val_compare_and_swap(&stats->min, min, n);
-    while (n > max) max = __sync_val_compare_and_swap(&stats->max, max, n);
+    if (n > stats->limit) return 0;
+    stats->data[stats_index(stats, n)]++;
+    stats->count++;
+    stats->min = MIN(stats->min, n);
+    stats->max = MAX(stats->max, n);
     return 1;
 }
 
+void stats_merge(stats *dst, stats *src) {
+    bool same = dst->digits == src->digits && dst->length == src->length;
+    uint64_t count = 0;
+
+    int32_t last = stats_index(src, src->max);
+    for (int32_t i = stats_index(src, src->min); i <= last; i++) {
+        uint64_t n = src->data[i];
+        if (!n) continue;
+        if (same) {
+            dst->data[i] += n;
+        } else {
+            uint64_t value = MIN(stats_value(src, i), dst->limit);
+            dst->data[stats_index(dst, value)] += n;
+        }
+        count += n;
+    }
+
+    if (count) {
+        dst->count += count;
+        dst->min = MIN(dst->min, src->min);
+        dst->max = MAX(dst->max, MIN(src->max, dst->limit));
+    }
+}
+
+void stats_reset(stats *stats) {
+    if (stats->count) {
+        int32_t first = stats_index(stats, stats->min);
+        int32_t last  = stats_index(stats, stats->max);
+        memset(&stats->data[first], 0, (last - first + 1) * sizeof(uint64_t));
+    }
+    stats->count   = 0;
+    stats->min     = UINT64_MAX;
+    stats->max     = 0;
+    stats->indexed = UINT64_MAX;
+}
+
 void stats_correct(stats *stats, int64_t expected) {
-    for (uint64_t n = expected * 2; n <= stats->max; n++) {
-        uint64_t count = stats->data[n];
-        int64_t m = (int64_t) n - expected;
+    if (expected <= 0 || stats->count == 0) return;
+    int32_t last = stats_index(stats, stats->max);
+    for (int32_t i = stats_index(stats, expected * 2); i <= last; i++) {
+        uint64_t count = stats->data[i];
+        int64_t m = (int64_t) stats_value(stats, i) - expected;
         while (count && m > expected) {
-            stats->data[m] += count;
+            stats->data[stats_index(stats, m)] += count;
             stats->count += count;
+            stats->min = MIN(stats->min, (uint64_t) m);
             m -= expected;
         }
     }
@@ -46,8 +188,11 @@ long double stats_mean(stats *stats) {
     if (stats->count == 0) return 0.0;
 
     uint64_t sum = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        sum += stats->data[i] * i;
+    int32_t last = stats_index(stats, stats->max);
+    for (int32_t i = stats_index(stats, stats->min); i <= last; i++) {
+        if (stats->data[i]) {
+            sum += stats->data[i] * stats_median(stats, i);
+        }
     }
     return sum / (long double) stats->count;
 }
@@ -55,9 +200,10 @@ long double stats_mean(stats *stats) {
 long double stats_stdev(stats *stats, long double mean) {
     long double sum = 0.0;
     if (stats->count < 2) return 0.0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
+    int32_t last = stats_index(stats, stats->max);
+    for (int32_t i = stats_index(stats, stats->min); i <= last; i++) {
         if (stats->data[i]) {
-            sum += powl(i - mean, 2) * stats->data[i];
+            sum += powl(stats_median(stats, i) - mean, 2) * stats->data[i];
         }
     }
     return sqrtl(sum / (stats->count - 1));
@@ -68,8 +214,10 @@ long double stats_within_stdev(stats *stats, long double mean, long double stdev
     long double lower = mean - (stdev * n);
     uint64_t sum = 0;
 
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (i >= lower && i <= upper) {
+    int32_t last = stats_index(stats, stats->max);
+    for (int32_t i = stats_index(stats, stats->min); i <= last; i++) {
+        uint64_t value = stats_median(stats, i);
+        if (value >= lower && value <= upper) {
             sum += stats->data[i];
         }
     }
@@ -78,30 +226,156 @@ long double stats_within_stdev(stats *stats, long double mean, long double stdev
 }
 
 uint64_t stats_percentile(stats *stats, long double p) {
-    uint64_t rank = round((p / 100.0) * stats->count + 0.5);
-    uint64_t total = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        total += stats->data[i];
-        if (total >= rank) return i;
+    stats_build(stats);
+    return stats_rank(stats, p);
+}
+
+void stats_percentiles(stats *stats, long double *p, uint64_t *values, size_t n) {
+    stats_build(stats);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = stats_rank(stats, p[i]);
     }
-    return 0;
 }
 
-uint64_t stats_popcount(stats *stats) {
-    uint64_t count = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (stats->data[i]) count++;
+void stats_spectrum(stats *stats, int ticks, stats_spectrum_func fn, void *data) {
+    long double target = 0.0;
+
+    stats_build(stats);
+    for (uint64_t n = 0; n < stats->entries; n++) {
+        uint64_t total = stats->totals[n];
+        uint64_t value = stats_highest(stats, stats->slots[n]);
+        long double current = (100.0 * total) / stats->count;
+
+        while (target <= current) {
+            fn(value, target, total, data);
+            long double half = powl(2, floorl(log2l(100.0 / (100.0 - target))) + 1);
+            target += 100.0 / (ticks * half);
+            if (total == stats->count) break;
+        }
+
+        if (total == stats->count) {
+            fn(value, 100.0, total, data);
+            return;
+        }
     }
-    return count;
 }
 
-uint64_t stats_value_at(stats *stats, uint64_t index, uint64_t *count) {
-    *count = 0;
-    for (uint64_t i = stats->min; i <= stats->max; i++) {
-        if (stats->data[i] && (*count)++ == index) {
-            *count = stats->data[i];
-            return i;
+#define ENCODING_COOKIE 0x1c849313
+#define ENCODING_HEADER 40
+
+static size_t put_varint(uint8_t *buf, int64_t n) {
+    uint64_t v = ((uint64_t) n << 1) ^ (uint64_t) (n >> 63);
+    size_t i = 0;
+    while (i < 8 && v >> 7) {
+        buf[i++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    buf[i++] = v;
+    return i;
+}
+
+static size_t get_varint(uint8_t *buf, size_t len, int64_t *n) {
+    uint64_t v = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t b = buf[i];
+        if (i == 8) {
+            v |= (uint64_t) b << 56;
+            i++;
+            break;
+        }
+        v |= (uint64_t) (b & 0x7f) << (i * 7);
+        i++;
+        if (!(b & 0x80)) break;
+    }
+    *n = (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+    return i;
+}
+
+// Serialize in the HdrHistogram V2 encoding: a fixed header followed by
+// zig-zag varint counts where runs of empty buckets are negative.
+size_t stats_encode(stats *stats, uint8_t **buf) {
+    int32_t limit = stats->count ? stats_index(stats, stats->max) + 1 : 0;
+    uint8_t *data = zmalloc(ENCODING_HEADER + (size_t) limit * 9 + 9);
+    size_t n = ENCODING_HEADER;
+
+    for (int32_t i = 0; i < limit; ) {
+        int64_t count = stats->data[i++];
+        int64_t zeros = 0;
+        if (count == 0) {
+            zeros = 1;
+            while (i < limit && stats->data[i] == 0) {
+                zeros++;
+                i++;
+            }
+        }
+        n += put_varint(&data[n], zeros > 1 ? -zeros : count);
+    }
+
+    union { double d; uint64_t u; } ratio = { .d = 1.0 };
+
+    put_u32(&data[0],  ENCODING_COOKIE);
+    put_u32(&data[4],  n - ENCODING_HEADER);
+    put_u32(&data[8],  0);
+    put_u32(&data[12], stats->digits);
+    put_u64(&data[16], 1);
+    put_u64(&data[24], stats->limit);
+    put_u64(&data[32], ratio.u);
+
+    *buf = data;
+    return n;
+}
+
+stats *stats_decode(uint8_t *buf, size_t len) {
+    if (len < ENCODING_HEADER || get_u32(buf) != ENCODING_COOKIE) return NULL;
+
+    size_t length   = get_u32(&buf[4]);
+    int32_t offset  = get_u32(&buf[8]);
+    int digits      = get_u32(&buf[12]);
+    uint64_t lowest = get_u64(&buf[16]);
+    uint64_t limit  = get_u64(&buf[24]);
+
+    if (offset != 0 || lowest == 0 || length > len - ENCODING_HEADER) return NULL;
+
+    stats *stats = stats_alloc(limit, digits);
+    int32_t unit = 63 - __builtin_clzll(lowest);
+    uint64_t max = 0, min = UINT64_MAX;
+    uint8_t *p = &buf[ENCODING_HEADER], *end = p + length;
+
+    for (int32_t i = 0; p < end && i < stats->length; ) {
+        int64_t count;
+        p += get_varint(p, end - p, &count);
+        if (count < 0) {
+            i -= count;
+            continue;
+        }
+        if (count > 0) {
+            uint64_t value = MIN(stats_value(stats, i) << unit, limit);
+            int32_t index  = stats_index(stats, value);
+            uint64_t width = UINT64_C(1) << (stats_bucket(stats, index));
+            stats->data[index] += count;
+            stats->count += count;
+            min = MIN(min, stats_value(stats, index));
+            max = MAX(max, stats_value(stats, index) + width - 1);
         }
+        i++;
     }
-    return 0;
+
+    stats->min = min;
+    stats->max = MIN(max, limit);
+    return stats;
+}
+
+uint64_t stats_popcount(stats *stats) {
+    stats_build(stats);
+    return stats->entries;
+}
+
+uint64_t stats_value_at(stats *stats, uint64_t index, uint64_t *count) {
+    *count = 0;
+    stats_build(stats);
+    if (index >= stats->entries) return 0;
+    int32_t i = stats->slots[index];
+    *count = stats->data[i];
+    return stats_highest(stats, i);
 }
@@ -2,6 +2,7 @@
 #define STATS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
@@ -15,24 +16,49 @@ typedef struct {
     uint32_t timeout;
 } errors;
 
+// Log-bucketed histogram in the HdrHistogram layout: values up to limit
+// are tracked with a relative error bounded by the significant digits.
+// Recording is not atomic, each thread records into its own instance
+// and the results are combined with stats_merge. Queries build an index
+// of the non-zero buckets and their cumulative counts, which is reused
+// until the count changes.
 typedef struct {
     uint64_t count;
     uint64_t limit;
     uint64_t min;
     uint64_t max;
+    int32_t  digits;
+    int32_t  magnitude;
+    int32_t  half;
+    int32_t  buckets;
+    uint64_t mask;
+    int32_t  length;
+    uint64_t indexed;
+    uint64_t entries;
+    int32_t  *slots;
+    uint64_t *totals;
     uint64_t data[];
 } stats;
 
-stats *stats_alloc(uint64_t);
+typedef void (*stats_spectrum_func)(uint64_t, long double, uint64_t, void *);
+
+stats *stats_alloc(uint64_t, int);
 void stats_free(stats *);
 
 int stats_record(stats *, uint64_t);
+void stats_merge(stats *, stats *);
+void stats_reset(stats *);
 void stats_correct(stats *, int64_t);
 
 long double stats_mean(stats *);
 long double stats_stdev(stats *stats, long double);
 long double stats_within_stdev(stats *, long double, long double, uint64_t);
 uint64_t stats_percentile(stats *, long double);
+void stats_percentiles(stats *, long double *, uint64_t *, size_t);
+void stats_spectrum(stats *, int, stats_spectrum_func, void *);
+
+size_t stats_encode(stats *, uint8_t **);
+stats *stats_decode(uint8_t *, size_t);
 
 uint64_t stats_popcount(stats *);
 uint64_t stats_value_at(stats *stats, uint64_t, uint64_t *);
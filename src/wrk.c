@@ -10,26 +10,56 @@ static struct config {
     uint64_t threads;
     uint64_t timeout;
     uint64_t pipeline;
+    uint64_t recvbuf;
+    uint64_t reuse;
+    uint64_t streams;
+    uint64_t rate;
+    uint64_t interval;
     bool     stream;
+    bool     response;
     bool     delay;
     bool     dynamic;
     bool     latency;
+    bool     phases;
+    bool     spectrum;
+    bool     merge;
+    bool     edge;
+    bool     handshakes;
+    bool     http2;
+    FILE    *hlog;
+    FILE    *json;
+    size_t   nsources;
+    source  *sources;
+    uint64_t naddrs;
+    size_t   npercentiles;
+    long double *percentiles;
     char    *host;
+    char    *unix;
     char    *script;
-    SSL_CTX *ctx;
+    bool     tls;
+    ssl_config ssl;
 } cfg;
 
 static struct {
     stats *latency;
     stats *requests;
+    stats *lag;
+    phases phases;
+    uint64_t status[STATUS_CODES];
+    stats *classes[STATUS_CLASSES];
+    uint64_t handshakes;
+    uint64_t resumed;
+    uint64_t ktls_recv;
+    uint64_t ktls_send;
+    char *tls;
+    uint64_t memory;
 } statistics;
 
 static struct sock sock = {
     .connect  = sock_connect,
     .close    = sock_close,
     .read     = sock_read,
-    .write    = sock_write,
-    .readable = sock_readable
+    .write    = sock_write
 };
 
 static struct http_parser_settings parser_settings = {
@@ -39,6 +69,7 @@ static struct http_parser_settings parser_settings = {
 static response_complete_func response_complete;
 
 static volatile sig_atomic_t stop = 0;
+static volatile uint64_t epoch = 0;
 
 static void handler(int sig) {
     stop = 1;
@@ -50,15 +81,37 @@ static void usage() {
            "    -c, --connections <N>  Connections to keep open   \n"
            "    -d, --duration    <T>  Duration of test           \n"
            "    -t, --threads     <N>  Number of threads to use   \n"
+           "    -R, --rate        <N>  Constant request rate/sec  \n"
            "                                                      \n"
            "    -s, --script      <S>  Load Lua script file       \n"
            "    -H, --header      <H>  Add header to request      \n"
            "        --latency          Print latency statistics   \n"
+           "        --percentiles <P>  Latency percentiles to show\n"
+           "        --latency-spectrum Print percentile spectrum  \n"
+           "        --latency-log <F>  Write HdrHistogram log     \n"
+           "        --merge <F>...     Merge HdrHistogram logs    \n"
+           "        --json        <F>  JSON summary file, - stdout\n"
            "        --timeout     <T>  Socket/request timeout     \n"
+           "        --interval    <T>  Report stats every interval\n"
+           "        --engine      <E>  Event loop, e.g. io_uring  \n"
+           "        --recv-buffer <N>  Receive buffer per thread  \n"
+           "        --source-ips  <A>  Local addresses to bind to \n"
+           "        --requests-per-connection <N>                 \n"
+           "                           Reconnect after N responses\n"
+           "        --tls-handshakes <M>                          \n"
+           "                           Handshakes: full or resumed\n"
+           "        --ktls             Use kernel TLS if available\n"
+           "        --tls-version <V>  TLS version, 1.0 to 1.3    \n"
+           "        --tls-ciphers <C>  TLS ciphers and 1.3 suites \n"
+           "        --tls-groups  <G>  Key exchange groups        \n"
+           "        --alpn        <P>  ALPN protocols to offer    \n"
+           "        --http2            Use HTTP/2, h2c or ALPN h2 \n"
+           "        --streams     <N>  Concurrent HTTP/2 streams  \n"
            "    -v, --version          Print version details      \n"
            "                                                      \n"
            "  Numeric arguments may include a SI unit (1k, 1M, 1G)\n"
-           "  Time arguments may include a time unit (2s, 2m, 2h)\n");
+           "  Time arguments may include a time unit (2s, 2m, 2h)\n"
+           "  Unix socket URLs: unix:///run/app.sock[:/path]      \n");
 }
 
 int main(int argc, char **argv) {
@@ -70,31 +123,59 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    if (cfg.merge) {
+        return merge_logs(argc - optind, &argv[optind]);
+    }
+
     char *schema  = copy_url_part(url, &parts, UF_SCHEMA);
     char *host    = copy_url_part(url, &parts, UF_HOST);
     char *port    = copy_url_part(url, &parts, UF_PORT);
     char *service = port ? port : schema;
+    char *target  = cfg.unix ? argv[optind] : url;
+
+    bool tls_tracked = false;
 
     if (!strncmp("https", schema, 5)) {
-        if ((cfg.ctx = ssl_init()) == NULL) {
-            fprintf(stderr, "unable to initialize SSL\n");
-            ERR_print_errors_fp(stderr);
-            exit(1);
+        cfg.tls = true;
+        tls_tracked = ssl_track_memory();
+        if (!tls_tracked) {
+            fprintf(stderr, "unable to track OpenSSL memory, memory per connection is not reported\n");
         }
+        if (cfg.http2 && !cfg.ssl.alpn) cfg.ssl.alpn = "h2";
         sock.connect  = ssl_connect;
         sock.close    = ssl_close;
         sock.read     = ssl_read;
         sock.write    = ssl_write;
-        sock.readable = ssl_readable;
+    } else if (cfg.handshakes || cfg.ssl.ktls || cfg.ssl.version || cfg.ssl.ciphers || cfg.ssl.groups || cfg.ssl.alpn) {
+        fprintf(stderr, "TLS options require an https URL\n");
+        exit(1);
     }
 
     signal(SIGPIPE, SIG_IGN);
     signal(SIGINT,  SIG_IGN);
 
-    statistics.latency  = stats_alloc(cfg.timeout * 1000);
-    statistics.requests = stats_alloc(MAX_THREAD_RATE_S);
+    uint64_t limit = cfg.timeout * 1000;
+    if (cfg.rate) limit += cfg.duration * 1000000;
+
+    statistics.latency  = stats_alloc(limit, STATS_DIGITS);
+    statistics.requests = stats_alloc(MAX_THREAD_RATE_S, STATS_DIGITS);
+    if (cfg.rate) statistics.lag = stats_alloc(limit, STATS_DIGITS);
     thread *threads     = zcalloc(cfg.threads * sizeof(thread));
 
+    cfg.phases = cfg.latency || cfg.reuse || cfg.handshakes;
+    if (cfg.phases) phases_alloc(&statistics.phases, limit);
+
+    if (cfg.latency) {
+        for (int i = 0; i < STATUS_CLASSES; i++) {
+            statistics.classes[i] = stats_alloc(limit, STATS_DIGITS);
+        }
+    }
+
+    if (cfg.unix) {
+        host    = cfg.unix;
+        service = "unix";
+    }
+
     lua_State *L = script_create(cfg.script, url, headers);
     if (!script_resolve(L, host, service)) {
         char *msg = strerror(errno);
@@ -109,29 +190,91 @@ int main(int argc, char **argv) {
         t->loop        = aeCreateEventLoop(10 + cfg.connections * 3);
         t->connections = cfg.connections / cfg.threads;
 
+        if (!t->loop) {
+            char *msg = strerror(errno);
+            fprintf(stderr, "unable to create %s event loop: %s\n", aeGetApiName(), msg);
+            exit(1);
+        }
+
+        t->latency     = stats_alloc(limit, STATS_DIGITS);
+        t->rates       = stats_alloc(MAX_THREAD_RATE_S, STATS_DIGITS);
+        if (cfg.rate) t->lag = stats_alloc(limit, STATS_DIGITS);
+        t->buf         = zmalloc(cfg.recvbuf);
+        t->source      = i;
+
+        // plain connections send and receive through io_uring directly
+        // when the engine supports it
+        t->uring = !cfg.tls && aeSetRecvBuffers(t->loop, cfg.recvbuf) == AE_OK;
+
+        // a context per thread, so threads do not contend on its locks
+        if (cfg.tls && (t->ctx = ssl_init(&cfg.ssl)) == NULL) {
+            fprintf(stderr, "unable to initialize SSL\n");
+            ERR_print_errors_fp(stderr);
+            exit(1);
+        }
+
+        if (cfg.phases) phases_alloc(&t->phases, limit);
+
+        if (cfg.latency) {
+            for (int i = 0; i < STATUS_CLASSES; i++) {
+                t->classes[i] = stats_alloc(limit, STATS_DIGITS);
+            }
+        }
+
+        if (cfg.interval) {
+            t->window         = stats_alloc(limit, STATS_DIGITS);
+            t->report.latency = stats_alloc(limit, STATS_DIGITS);
+        }
+
         t->L = script_create(cfg.script, url, headers);
         script_init(L, t, argc - optind, &argv[optind]);
 
         if (i == 0) {
+            for (size_t j = 0; j < cfg.nsources; j++) {
+                if (cfg.sources[j].family != t->addr->ai_family) {
+                    fprintf(stderr, "source addresses must match the address family of %s\n", host);
+                    exit(1);
+                }
+            }
+
             cfg.dynamic  = !script_is_static(t->L);
-            cfg.delay    = script_has_delay(t->L);
+            cfg.delay    = script_has_delay(t->L) && !cfg.rate;
+            cfg.edge     = aeGetApiEdgeTriggered();
             cfg.stream   = script_want_stream_response(t->L);
 
-            if (cfg.stream) {
+            if (cfg.http2) {
+                cfg.pipeline = script_verify_request(t->L);
+                if (cfg.rate || cfg.delay || cfg.stream || script_want_response(t->L) || cfg.pipeline > 1) {
+                    fprintf(stderr, "--http2 does not support --rate, delay(), response() or pipelining\n");
+                    exit(1);
+                }
+                response_complete = http2_response_complete;
+            } else if (cfg.stream) {
                 response_complete = stream_response_complete;
             } else {
                 cfg.pipeline = script_verify_request(t->L);
                 response_complete = http_response_complete;
             }
 
-            if (script_want_response(t->L) || cfg.stream) {
+            if (cfg.latency) {
+                parser_settings.on_message_begin = message_begin;
+            }
+
+            cfg.response = script_want_response(t->L) || cfg.stream;
+            if (cfg.response) {
                 parser_settings.on_header_field = header_field;
                 parser_settings.on_header_value = header_value;
                 parser_settings.on_body         = response_body;
             }
         }
+    }
+
+    // library initialization and the contexts are not per connection
+    size_t tls_memory = ssl_used_memory();
 
-        if (!t->loop || pthread_create(&t->thread, NULL, &thread_main, t)) {
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        thread *t = &threads[i];
+        if (pthread_create(&t->thread, NULL, &thread_main, t)) {
             char *msg = strerror(errno);
             fprintf(stderr, "unable to create thread %"PRIu64": %s\n", i, msg);
             exit(2);
@@ -146,15 +289,51 @@ int main(int argc, char **argv) {
     sigaction(SIGINT, &sa, NULL);
 
     char *time = format_time_s(cfg.duration);
-    printf("Running %s test @ %s\n", time, url);
+    printf("Running %s test @ %s\n", time, target);
     printf("  %"PRIu64" threads and %"PRIu64" connections\n", cfg.threads, cfg.connections);
+    if (cfg.http2) {
+        printf("  HTTP/2 with %"PRIu64" streams per connection\n", cfg.streams);
+    }
+    if (cfg.rate) {
+        char *rate = format_metric(cfg.rate);
+        printf("  constant rate of %s requests/sec\n", rate);
+    }
 
     uint64_t start    = time_us();
     uint64_t complete = 0;
+
+    if (cfg.hlog) hlog_header(cfg.hlog, start);
+
     uint64_t bytes    = 0;
+    uint64_t connects = 0;
     errors errors     = { 0 };
 
-    sleep(cfg.duration);
+    if (cfg.interval) {
+        stats *window = stats_alloc(limit, STATS_DIGITS);
+        uint64_t elapsed = 0, length = cfg.interval * 1000000;
+
+        print_interval_header();
+        while (!stop && elapsed < cfg.duration * 1000000) {
+            uint64_t next = MIN(elapsed + length, cfg.duration * 1000000);
+            uint64_t now  = time_us() - start;
+            if (next > now) usleep(next - now);
+            if (stop) break;
+            record_interval(threads, window, next, next - elapsed);
+            elapsed = next;
+        }
+
+        stats_free(window);
+    } else {
+        sleep(cfg.duration);
+    }
+
+    // sampled while every connection is still open
+    tls_memory = ssl_used_memory() - tls_memory;
+    if (!cfg.tls || tls_tracked) {
+        statistics.memory = sizeof(connection) + sizeof(connection_cold);
+        if (cfg.http2) statistics.memory += sizeof(http2) + cfg.streams * sizeof(http2_stream);
+        statistics.memory += tls_memory / cfg.connections;
+    }
     stop = 1;
 
     for (uint64_t i = 0; i < cfg.threads; i++) {
@@ -163,12 +342,34 @@ int main(int argc, char **argv) {
 
         complete += t->complete;
         bytes    += t->bytes;
+        connects += t->connects;
+
+        statistics.handshakes += t->handshakes;
+        statistics.resumed    += t->resumed;
+        statistics.ktls_recv  += t->ktls_recv;
+        statistics.ktls_send  += t->ktls_send;
+        if (!statistics.tls) statistics.tls = t->tls;
 
         errors.connect += t->errors.connect;
         errors.read    += t->errors.read;
         errors.write   += t->errors.write;
         errors.timeout += t->errors.timeout;
         errors.status  += t->errors.status;
+
+        stats_merge(statistics.latency,  t->latency);
+        stats_merge(statistics.requests, t->rates);
+        if (cfg.rate) stats_merge(statistics.lag, t->lag);
+        for (int i = 0; i < STATUS_CODES; i++) {
+            statistics.status[i] += t->status[i];
+        }
+
+        if (cfg.phases) phases_merge(&statistics.phases, &t->phases);
+
+        if (cfg.latency) {
+            for (int i = 0; i < STATUS_CLASSES; i++) {
+                stats_merge(statistics.classes[i], t->classes[i]);
+            }
+        }
     }
 
     uint64_t runtime_us = time_us() - start;
@@ -176,19 +377,44 @@ int main(int argc, char **argv) {
     long double req_per_s   = complete   / runtime_s;
     long double bytes_per_s = bytes      / runtime_s;
 
-    if (complete / cfg.connections > 0) {
-        int64_t interval = runtime_us / (complete / cfg.connections);
+    uint64_t concurrent = cfg.connections * (cfg.http2 ? cfg.streams : 1);
+    bool corrected = !cfg.rate && complete / concurrent > 0;
+    if (corrected) {
+        int64_t interval = runtime_us / (complete / concurrent);
         stats_correct(statistics.latency, interval);
+        if (cfg.phases) stats_correct(statistics.phases.ttfb, interval);
+        if (cfg.latency) {
+            for (int i = 0; i < STATUS_CLASSES; i++) {
+                stats_correct(statistics.classes[i], interval);
+            }
+        }
     }
 
+    if (cfg.hlog) hlog_write(cfg.hlog, "total", 0, runtime_us, statistics.latency);
+
     print_stats_header();
-    print_stats("Latency", statistics.latency, format_time_us);
-    print_stats("Req/Sec", statistics.requests, format_metric);
+    if (!cfg.handshakes) {
+        print_stats("Latency", statistics.latency, format_time_us);
+        print_stats("Req/Sec", statistics.requests, format_metric);
+        if (cfg.rate) print_stats("Send lag", statistics.lag, format_time_us);
+    }
+    if (cfg.phases) print_stats_phases(&statistics.phases);
+    if (cfg.latency) print_stats_classes(statistics.classes);
+    if (cfg.phases && corrected) {
+        printf("  Connect, TLS and Transfer are not corrected for coordinated omission\n");
+    }
     if (cfg.latency) print_stats_latency(statistics.latency);
+    if (cfg.spectrum) print_stats_spectrum(statistics.latency);
 
     char *runtime_msg = format_time_us(runtime_us);
 
     printf("  %"PRIu64" requests in %s, %sB read\n", complete, runtime_msg, format_binary(bytes));
+    if (statistics.tls) printf("  TLS: %s\n", statistics.tls);
+    if (cfg.tls && statistics.memory) {
+        char *memory = format_binary(statistics.memory);
+        char *tls    = format_binary(tls_memory / cfg.connections);
+        printf("  Memory per connection: %sB, TLS %sB\n", memory, tls);
+    }
     if (errors.connect || errors.read || errors.write || errors.timeout) {
         printf("  Socket errors: connect %d, read %d, write %d, timeout %d\n",
                errors.connect, errors.read, errors.write, errors.timeout);
@@ -198,12 +424,29 @@ int main(int argc, char **argv) {
         printf("  Non-2xx or 3xx responses: %d\n", errors.status);
     }
 
+    print_status(statistics.status);
+
+    if (cfg.reuse || connects > cfg.connections) {
+        printf("Connects/sec: %9.2Lf\n", connects / runtime_s);
+    }
+    if (cfg.tls && (cfg.handshakes || cfg.reuse || connects > cfg.connections)) {
+        uint64_t full = statistics.handshakes - statistics.resumed;
+        printf("Handshakes/sec: full %.2Lf, resumed %.2Lf\n",
+               full / runtime_s, statistics.resumed / runtime_s);
+    }
+    if (cfg.ssl.ktls) {
+        printf("kTLS handshakes: receive %"PRIu64", send %"PRIu64" of %"PRIu64"\n",
+               statistics.ktls_recv, statistics.ktls_send, statistics.handshakes);
+    }
     printf("Requests/sec: %9.2Lf\n", req_per_s);
     printf("Transfer/sec: %10sB\n", format_binary(bytes_per_s));
 
+    if (cfg.json) print_json(target, runtime_us, complete, bytes, connects, &errors);
+
     if (script_has_done(L)) {
         script_summary(L, runtime_us, complete, bytes);
         script_errors(L, &errors);
+        script_status(L, statistics.status);
         script_done(L, statistics.latency, statistics.requests);
     }
 
@@ -220,16 +463,33 @@ void *thread_main(void *arg) {
         script_request(thread->L, &request, &length);
     }
 
-    thread->cs = zcalloc(thread->connections * sizeof(connection));
+    if (cfg.rate) {
+        long double rate = cfg.rate / (long double) cfg.threads / thread->connections;
+        thread->interval = MAX(cfg.pipeline, 1) * 1000000 / rate;
+    }
+
+    thread->cs   = zcalloc(thread->connections * sizeof(connection));
+    thread->cold = zcalloc(thread->connections * sizeof(connection_cold));
+
+    if (cfg.http2) {
+        thread->h2      = zcalloc(thread->connections * sizeof(http2));
+        thread->streams = zcalloc(thread->connections * cfg.streams * sizeof(http2_stream));
+        if (!cfg.dynamic && !http2_request_encode(&thread->request, request, length, cfg.host, cfg.tls)) {
+            fprintf(stderr, "unable to convert request to HTTP/2, bodies are limited to 64KB\n");
+            exit(1);
+        }
+    }
     connection *c = thread->cs;
+    uint64_t now = time_us();
 
     for (uint64_t i = 0; i < thread->connections; i++, c++) {
         c->thread = thread;
-        c->ssl     = cfg.ctx ? SSL_new(cfg.ctx) : NULL;
         c->request = request;
         c->length  = length;
         c->delayed = cfg.delay;
+        c->next    = now + (thread->interval * i) / thread->connections;
         connect_socket(thread, c);
+        aeCreateTimeEvent(thread->loop, cfg.timeout, check_timeout, c, NULL);
     }
 
     aeEventLoop *loop = thread->loop;
@@ -240,6 +500,9 @@ void *thread_main(void *arg) {
 
     aeDeleteEventLoop(loop);
     zfree(thread->cs);
+    zfree(thread->cold);
+    zfree(thread->h2);
+    zfree(thread->streams);
 
     return NULL;
 }
@@ -249,35 +512,54 @@ static int connect_socket(thread *thread, connection *c) {
     struct aeEventLoop *loop = thread->loop;
     int fd, flags;
 
+    c->connected = 0;
+    c->responses = 0;
+    c->generation++;
     fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
 
     flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 
+    if (thread->ctx && !c->ssl && !(c->ssl = SSL_new(thread->ctx))) goto error;
+    if (cfg.nsources && bind_source(thread, fd) == -1) goto error;
+
     if (connect(fd, addr->ai_addr, addr->ai_addrlen) == -1) {
         if (errno != EINPROGRESS) goto error;
     }
 
-    flags = 1;
-    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    if (addr->ai_family != AF_UNIX) {
+        flags = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flags, sizeof(flags));
+    }
 
     flags = AE_READABLE | AE_WRITABLE;
     if (aeCreateFileEvent(loop, fd, flags, socket_connected, c) == AE_OK) {
         c->parser.data = c;
         c->fd = fd;
+        uint64_t now = time_us();
+        cold(c)->connecting = now;
+        c->deadline = now + cfg.timeout * 1000;
         return fd;
     }
 
   error:
     thread->errors.connect++;
     close(fd);
+    c->fd = -1;
+    c->deadline = time_us() + cfg.timeout * 1000;
     return -1;
 }
 
 static int reconnect_socket(thread *thread, connection *c) {
-    aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE);
-    sock.close(c);
-    close(c->fd);
+    if (cfg.handshakes && cold(c)->ticket) {
+        aeDeleteTimeEvent(thread->loop, cold(c)->ticket_timer);
+        cold(c)->ticket = false;
+    }
+    if (c->fd >= 0) {
+        aeDeleteFileEvent(thread->loop, c->fd, AE_WRITABLE | AE_READABLE | AE_RECV | AE_SEND);
+        sock.close(c);
+        close(c->fd);
+    }
     return connect_socket(thread, c);
 }
 
@@ -288,26 +570,107 @@ static int record_rate(aeEventLoop *loop, long long id, void *data) {
         uint64_t elapsed_ms = (time_us() - thread->start) / 1000;
         uint64_t requests = (thread->requests / (double) elapsed_ms) * 1000;
 
-        stats_record(statistics.requests, requests);
+        stats_record(thread->rates, requests);
 
         thread->requests = 0;
         thread->start    = time_us();
     }
 
+    uint64_t current = epoch;
+    if (cfg.interval && thread->report.epoch != current) {
+        snapshot *report = &thread->report;
+        stats *window    = thread->window;
+
+        __sync_synchronize();
+        if (report->taken == report->epoch) {
+            thread->window  = report->latency;
+            report->latency = window;
+        } else {
+            // the last report was skipped, it goes out with this one
+            stats_merge(report->latency, window);
+            stats_reset(window);
+        }
+        report->complete = thread->complete;
+        report->bytes    = thread->bytes;
+        report->errors   = thread->errors;
+
+        __sync_synchronize();
+        report->epoch = current;
+    }
+
     if (stop) aeStop(loop);
 
     return RECORD_INTERVAL_MS;
 }
 
+static void record_interval(thread *threads, stats *window, uint64_t elapsed, uint64_t length) {
+    uint64_t current = __sync_add_and_fetch(&epoch, 1);
+    uint64_t complete = 0, bytes = 0;
+    errors errors = { 0 };
+
+    for (int wait = 0; wait < RECORD_INTERVAL_MS * 2; wait++) {
+        uint64_t acked = 0;
+        for (uint64_t i = 0; i < cfg.threads; i++) {
+            if (threads[i].report.epoch == current) acked++;
+        }
+        if (acked == cfg.threads) break;
+        usleep(1000);
+    }
+    __sync_synchronize();
+
+    for (uint64_t i = 0; i < cfg.threads; i++) {
+        thread *t = &threads[i];
+        snapshot *report = &t->report, *last = &t->last;
+        if (report->epoch != current) continue;
+
+        complete += report->complete - last->complete;
+        bytes    += report->bytes    - last->bytes;
+
+        errors.connect += report->errors.connect - last->errors.connect;
+        errors.read    += report->errors.read    - last->errors.read;
+        errors.write   += report->errors.write   - last->errors.write;
+        errors.timeout += report->errors.timeout - last->errors.timeout;
+        errors.status  += report->errors.status  - last->errors.status;
+
+        stats_merge(window, report->latency);
+        stats_reset(report->latency);
+
+        report->taken  = current;
+        last->complete = report->complete;
+        last->bytes    = report->bytes;
+        last->errors   = report->errors;
+    }
+
+    print_interval(elapsed, length, complete, &errors, window);
+    if (cfg.hlog) hlog_write(cfg.hlog, NULL, elapsed - length, length, window);
+    stats_reset(window);
+}
+
+static int check_timeout(aeEventLoop *loop, long long id, void *data) {
+    connection *c = data;
+    uint64_t now = time_us();
+
+    if (!c->deadline) return cfg.timeout;
+
+    if (now >= c->deadline) {
+        // a failed connect is retried once the timeout has passed
+        if (c->fd >= 0) c->thread->errors.timeout++;
+        reconnect_socket(c->thread, c);
+        return cfg.timeout;
+    }
+
+    return (c->deadline - now + 999) / 1000;
+}
+
 static int delay_request(aeEventLoop *loop, long long id, void *data) {
     connection *c = data;
     c->delayed = false;
-    aeCreateFileEvent(loop, c->fd, AE_WRITABLE, socket_writeable, c);
+    if (c->fd >= 0) socket_writeable(loop, c->fd, c, AE_WRITABLE);
     return AE_NOMORE;
 }
 
 static int header_field(http_parser *parser, const char *at, size_t len) {
-    connection *c = parser->data;
+    connection_cold *c = cold(parser->data);
     if (c->state == VALUE) {
         *c->headers.cursor++ = '\0';
         c->state = FIELD;
@@ -317,7 +680,7 @@ static int header_field(http_parser *parser, const char *at, size_t len) {
 }
 
 static int header_value(http_parser *parser, const char *at, size_t len) {
-    connection *c = parser->data;
+    connection_cold *c = cold(parser->data);
     if (c->state == FIELD) {
         *c->headers.cursor++ = '\0';
         c->state = VALUE;
@@ -327,11 +690,17 @@ static int header_value(http_parser *parser, const char *at, size_t len) {
 }
 
 static int response_body(http_parser *parser, const char *at, size_t len) {
-    connection *c = parser->data;
+    connection_cold *c = cold(parser->data);
     buffer_append(&c->body, at, len);
     return 0;
 }
 
+static int message_begin(http_parser *parser) {
+    connection_cold *c = cold(parser->data);
+    c->first = time_us();
+    return 0;
+}
+
 static int message_complete(http_parser *parser) {
     connection *c = parser->data;
     thread *thread = c->thread;
@@ -345,63 +714,202 @@ static int message_complete(http_parser *parser) {
         thread->errors.status++;
     }
 
-    if (c->headers.buffer) {
-        *c->headers.cursor++ = '\0';
-        script_response(thread->L, status, &c->headers, &c->body);
-        c->state = FIELD;
+    if (status >= STATUS_MIN && status < STATUS_MIN + STATUS_CODES) {
+        thread->status[status - STATUS_MIN]++;
     }
 
+    if (cfg.response || cfg.latency) {
+        connection_cold *cc = cold(c);
+
+        if (cc->headers.buffer) {
+            *cc->headers.cursor++ = '\0';
+            script_response(thread->L, status, &cc->headers, &cc->body);
+            cc->state = FIELD;
+        }
+
+        if (cfg.latency) {
+            stats_record(thread->phases.ttfb, cc->first - c->start);
+            stats_record(thread->phases.transfer, now - cc->first);
+        }
+    }
+
+    bool next = false;
     if (--c->pending == 0) {
-        if (!stats_record(statistics.latency, now - c->start)) {
+        if (!stats_record(thread->latency, now - c->start)) {
             thread->errors.timeout++;
         }
+        if (cfg.interval) stats_record(thread->window, now - c->start);
+        if (cfg.latency && status >= STATUS_MIN && status < STATUS_MIN + STATUS_CODES) {
+            stats_record(thread->classes[status / 100 - 1], now - c->start);
+        }
+        c->deadline = 0;
         c->delayed = cfg.delay;
-        aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
+        next = true;
     }
 
-    if (!http_should_keep_alive(parser)) {
+    c->responses++;
+    if (!http_should_keep_alive(parser) || (cfg.reuse && c->responses >= cfg.reuse && next)) {
         reconnect_socket(thread, c);
         goto done;
     }
 
     http_parser_init(parser, HTTP_RESPONSE);
 
+    // send the next request right away, socket_writeable only waits
+    // for the socket to become writable when the write can't complete
+    if (next) socket_writeable(thread->loop, c->fd, c, AE_WRITABLE);
+
   done:
     return 0;
 }
 
-bool http_response_complete(connection *c, size_t n) {
-    if (http_parser_execute(&c->parser, &parser_settings, c->buf, n) != n)
+bool http_response_complete(connection *c, char *buf, size_t n) {
+    if (http_parser_execute(&c->parser, &parser_settings, buf, n) != n)
         return false;
     if (n == 0 && !http_body_is_final(&c->parser))
         return false;
     return true;
 }
 
-bool stream_response_complete(connection *c, size_t n) {
+bool stream_response_complete(connection *c, char *buf, size_t n) {
     uint64_t now = time_us();
     thread *thread = c->thread;
 
+    int status;
+
     thread->complete++;
     thread->requests++;
 
-    if (!script_stream_response(thread->L, c->buf, n))
+    if (!script_stream_response(thread->L, buf, n, &status))
         thread->errors.status++;
 
-    if (!stats_record(statistics.latency, now - c->start))
+    if (!stats_record(thread->latency, now - c->start))
         thread->errors.timeout++;
+    if (cfg.interval) stats_record(thread->window, now - c->start);
+
+    if (status >= STATUS_MIN && status < STATUS_MIN + STATUS_CODES) {
+        thread->status[status - STATUS_MIN]++;
+        if (cfg.latency) stats_record(thread->classes[status / 100 - 1], now - c->start);
+    }
 
+    c->deadline = 0;
     c->delayed = cfg.delay;
-    aeCreateFileEvent(thread->loop, c->fd, AE_WRITABLE, socket_writeable, c);
 
     if (n == 0)
         reconnect_socket(thread, c);
+    else
+        socket_writeable(thread->loop, c->fd, c, AE_WRITABLE);
 
     return true;
 }
 
+bool http2_response_complete(connection *c, char *buf, size_t n) {
+    thread *thread = c->thread;
+    http2 *h = h2(c);
+
+    if (n == 0) {
+        reconnect_socket(thread, c);
+        return true;
+    }
+
+    if (!http2_parse(h, (uint8_t *) buf, n, time_us(), http2_stream_complete, c))
+        return false;
+
+    if ((h->goaway || (cfg.reuse && h->opened >= cfg.reuse)) && !h->active) {
+        reconnect_socket(thread, c);
+        return true;
+    }
+
+    http2_writeable(thread->loop, c);
+    return true;
+}
+
+static void http2_stream_complete(void *data, http2_stream *s, bool reset) {
+    connection *c = data;
+    thread *thread = c->thread;
+    uint64_t now = time_us();
+    uint32_t status = s->status;
+
+    c->deadline = h2(c)->active ? now + cfg.timeout * 1000 : 0;
+
+    if (reset) {
+        thread->errors.read++;
+        return;
+    }
+
+    thread->complete++;
+    thread->requests++;
+    c->responses++;
+
+    if (!status || status > 399) {
+        thread->errors.status++;
+    }
+
+    if (status >= STATUS_MIN && status < STATUS_MIN + STATUS_CODES) {
+        thread->status[status - STATUS_MIN]++;
+    }
+
+    if (!stats_record(thread->latency, now - s->start)) {
+        thread->errors.timeout++;
+    }
+    if (cfg.interval) stats_record(thread->window, now - s->start);
+
+    if (cfg.latency) {
+        stats_record(thread->phases.ttfb, s->first - s->start);
+        stats_record(thread->phases.transfer, now - s->first);
+        if (status >= STATUS_MIN && status < STATUS_MIN + STATUS_CODES) {
+            stats_record(thread->classes[status / 100 - 1], now - s->start);
+        }
+    }
+}
+
+// open as many streams as allowed and write out everything queued
+static void http2_writeable(aeEventLoop *loop, connection *c) {
+    thread *thread = c->thread;
+    http2 *h = h2(c);
+    uint64_t now = time_us();
+    size_t n;
+
+    while (http2_can_submit(h) && !(cfg.reuse && h->opened >= cfg.reuse)) {
+        if (cfg.dynamic) {
+            script_request(thread->L, &c->request, &c->length);
+            http2_request_free(&thread->request);
+            if (!http2_request_encode(&thread->request, c->request, c->length, cfg.host, cfg.tls))
+                goto error;
+        }
+        if (!http2_submit(h, &thread->request, now)) break;
+        if (!c->deadline) c->deadline = now + cfg.timeout * 1000;
+    }
+
+    // the server's stream limit or windows leave no room for a request,
+    // time out rather than keep an idle connection
+    if (!h->active && !c->deadline) c->deadline = now + cfg.timeout * 1000;
+
+    while (h->sent < h->outlen) {
+        switch (sock.write(c, (char *) h->out + h->sent, h->outlen - h->sent, &n)) {
+            case OK:    break;
+            case ERROR: goto error;
+            case RETRY: socket_wait_writable(loop, c, true); return;
+        }
+        http2_sent(h, n);
+    }
+    socket_wait_writable(loop, c, false);
+
+    return;
+
+  error:
+    thread->errors.write++;
+    reconnect_socket(thread, c);
+}
+
 static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
+    thread *thread = c->thread;
+
+    if (!c->connected) {
+        c->connected = time_us();
+        if (cfg.phases) stats_record(thread->phases.connect, c->connected - cold(c)->connecting);
+    }
 
     switch (sock.connect(c, cfg.host)) {
         case OK:    break;
@@ -409,11 +917,55 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
         case RETRY: return;
     }
 
+    if (c->ssl) {
+        if (cfg.phases) stats_record(thread->phases.handshake, time_us() - c->connected);
+        thread->handshakes++;
+        if (ssl_resumed(c)) thread->resumed++;
+        if (cfg.ssl.ktls) {
+            c->ktls = ssl_ktls_recv(c);
+            thread->ktls_recv += c->ktls;
+            thread->ktls_send += ssl_ktls_send(c);
+        }
+        if (!thread->tls) thread->tls = ssl_describe(c);
+    }
+
+    thread->connects++;
+
+    if (cfg.handshakes) {
+        if (cfg.ssl.resume && !ssl_resumable(c)) {
+            // servers may not send a new ticket on resumption, so only
+            // wait about as long as the handshake took for one
+            uint64_t now  = time_us();
+            uint64_t wait = 2 * (now - c->connected) / 1000 + 1;
+            connection_cold *cc = cold(c);
+            cc->ticket       = true;
+            cc->ticket_timer = aeCreateTimeEvent(loop, wait, session_expired, c, NULL);
+            c->deadline = 0;
+            aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+            aeCreateFileEvent(loop, fd, AE_READABLE, session_readable, c);
+            return;
+        }
+        reconnect_socket(thread, c);
+        return;
+    }
+
+    if (cfg.http2) {
+        if (c->ssl && !ssl_selected(c, "h2")) goto error;
+        uint64_t index = c - thread->cs;
+        http2_init(h2(c), &thread->streams[index * cfg.streams], cfg.streams);
+    }
+
     http_parser_init(&c->parser, HTTP_RESPONSE);
-    c->written = 0;
+    c->written  = 0;
+    c->deadline = 0;
 
-    aeCreateFileEvent(c->thread->loop, fd, AE_READABLE, socket_readable, c);
-    aeCreateFileEvent(c->thread->loop, fd, AE_WRITABLE, socket_writeable, c);
+    if (thread->uring) {
+        aeDeleteFileEvent(loop, fd, AE_READABLE);
+        if (aeCreateRecvEvent(loop, fd, socket_received, c) != AE_OK) goto error;
+    } else {
+        aeCreateFileEvent(loop, fd, AE_READABLE, socket_readable, c);
+    }
+    aeCreateFileEvent(loop, fd, AE_WRITABLE, socket_writeable, c);
 
     return;
 
@@ -422,40 +974,93 @@ static void socket_connected(aeEventLoop *loop, int fd, void *data, int mask) {
     reconnect_socket(c->thread, c);
 }
 
+// TLS 1.3 session tickets arrive after the handshake, read until one
+// has been saved or session_expired gives up
+static void session_readable(aeEventLoop *loop, int fd, void *data, int mask) {
+    connection *c = data;
+    size_t n;
+    status s;
+
+    while ((s = sock.read(c, c->thread->buf, cfg.recvbuf, &n)) == OK) {
+        if (ssl_resumable(c)) break;
+    }
+
+    if (s == ERROR) {
+        c->thread->errors.read++;
+    } else if (!ssl_resumable(c)) {
+        return;
+    }
+    reconnect_socket(c->thread, c);
+}
+
+// no ticket arrived, reopen offering the session that was just used
+static int session_expired(aeEventLoop *loop, long long id, void *data) {
+    connection *c = data;
+    cold(c)->ticket = false;
+    reconnect_socket(c->thread, c);
+    return AE_NOMORE;
+}
+
 static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
     thread *thread = c->thread;
 
+    if (cfg.http2) {
+        http2_writeable(loop, c);
+        return;
+    }
+
     if (c->delayed) {
         uint64_t delay = script_delay(thread->L);
-        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
+        socket_wait_writable(loop, c, false);
         aeCreateTimeEvent(loop, delay, delay_request, c, NULL);
         return;
     }
 
     if (!c->written) {
+        uint64_t now = time_us();
+
+        // timers only fire on millisecond ticks, so wake up on the tick
+        // before the request is due and send it up to a tick early,
+        // measuring from when it was actually sent
+        if (c->next > now + 1000) {
+            uint64_t delay = (c->next - now) / 1000;
+            socket_wait_writable(loop, c, false);
+            aeCreateTimeEvent(loop, delay, delay_request, c, NULL);
+            return;
+        }
+
         if (cfg.dynamic) {
             script_request(thread->L, &c->request, &c->length);
         }
-        c->start   = time_us();
-        c->pending = cfg.pipeline;
+        if (cfg.rate) stats_record(thread->lag, now > c->next ? now - c->next : 0);
+        c->start    = cfg.rate ? MIN(c->next, now) : now;
+        c->next    += thread->interval;
+        c->pending  = cfg.pipeline;
+        c->deadline = now + cfg.timeout * 1000;
     }
 
     char  *buf = c->request + c->written;
     size_t len = c->length  - c->written;
     size_t n;
 
+    if (thread->uring) {
+        if (aeSend(loop, c->fd, buf, len, socket_sent, c) != AE_OK) goto error;
+        socket_wait_writable(loop, c, false);
+        return;
+    }
+
     switch (sock.write(c, buf, len, &n)) {
         case OK:    break;
         case ERROR: goto error;
-        case RETRY: return;
+        case RETRY: socket_wait_writable(loop, c, true); return;
     }
 
     c->written += n;
     if (c->written == c->length) {
         c->written = 0;
-        aeDeleteFileEvent(loop, fd, AE_WRITABLE);
     }
+    socket_wait_writable(loop, c, c->written > 0);
 
     return;
 
@@ -464,22 +1069,61 @@ static void socket_writeable(aeEventLoop *loop, int fd, void *data, int mask) {
     reconnect_socket(thread, c);
 }
 
+static void socket_wait_writable(aeEventLoop *loop, connection *c, bool wait) {
+    bool waiting = aeGetFileEvents(loop, c->fd) & AE_WRITABLE;
+    if (wait && !waiting) {
+        aeCreateFileEvent(loop, c->fd, AE_WRITABLE, socket_writeable, c);
+    } else if (!wait && waiting) {
+        aeDeleteFileEvent(loop, c->fd, AE_WRITABLE);
+    }
+}
+
+// only called when a send through io_uring failed
+static void socket_sent(aeEventLoop *loop, int fd, void *data, long n) {
+    connection *c = data;
+    c->thread->errors.write++;
+    reconnect_socket(c->thread, c);
+}
+
+static void socket_received(aeEventLoop *loop, int fd, void *data, char *buf, long n) {
+    connection *c = data;
+    uint16_t generation = c->generation;
+
+    if (n < 0) goto error;
+    if (!response_complete(c, buf ? buf : c->thread->buf, n))
+        goto error;
+
+    c->thread->bytes += n;
+
+    // the receive ends when the server closes the connection
+    if (n == 0 && c->generation == generation) reconnect_socket(c->thread, c);
+
+    return;
+
+  error:
+    c->thread->errors.read++;
+    reconnect_socket(c->thread, c);
+}
+
 static void socket_readable(aeEventLoop *loop, int fd, void *data, int mask) {
     connection *c = data;
+    char *buf = c->thread->buf;
+    uint16_t generation = c->generation;
     size_t n;
 
+    // stop once response_complete has reconnected the connection
     do {
-        switch (sock.read(c, &n)) {
+        switch (sock.read(c, buf, cfg.recvbuf, &n)) {
             case OK:    break;
             case ERROR: goto error;
             case RETRY: return;
         }
 
-        if (!response_complete(c, n))
+        if (!response_complete(c, buf, n))
             goto error;
 
         c->thread->bytes += n;
-    } while (n == RECVBUF && sock.readable(c) > 0);
+    } while (n > 0 && c->generation == generation && (n == cfg.recvbuf || cfg.edge));
 
     return;
 
@@ -494,6 +1138,53 @@ static uint64_t time_us() {
     return (t.tv_sec * 1000000) + t.tv_usec;
 }
 
+static connection_cold *cold(connection *c) {
+    return &c->thread->cold[c - c->thread->cs];
+}
+
+static http2 *h2(connection *c) {
+    return &c->thread->h2[c - c->thread->cs];
+}
+
+static void phases_alloc(phases *phases, uint64_t limit) {
+    phases->connect   = stats_alloc(limit, STATS_DIGITS);
+    phases->handshake = stats_alloc(limit, STATS_DIGITS);
+    phases->ttfb      = stats_alloc(limit, STATS_DIGITS);
+    phases->transfer  = stats_alloc(limit, STATS_DIGITS);
+}
+
+static void phases_merge(phases *dst, phases *src) {
+    stats_merge(dst->connect,   src->connect);
+    stats_merge(dst->handshake, src->handshake);
+    stats_merge(dst->ttfb,      src->ttfb);
+    stats_merge(dst->transfer,  src->transfer);
+}
+
+static int merge_logs(int count, char **files) {
+    stats *latency = NULL;
+
+    for (int i = 0; i < count; i++) {
+        if (hlog_read(files[i], &latency)) {
+            fprintf(stderr, "unable to read latency log %s\n", files[i]);
+            return 1;
+        }
+    }
+
+    if (!latency) {
+        fprintf(stderr, "no histograms found\n");
+        return 1;
+    }
+
+    printf("Merged %d latency logs\n", count);
+    print_stats_header();
+    print_stats("Latency", latency, format_time_us);
+    print_stats_latency(latency);
+    if (cfg.spectrum) print_stats_spectrum(latency);
+    printf("  %"PRIu64" requests\n", latency->count);
+
+    return 0;
+}
+
 static char *copy_url_part(char *url, struct http_parser_url *parts, enum http_parser_url_fields field) {
     char *part = NULL;
 
@@ -511,10 +1202,29 @@ static struct option longopts[] = {
     { "connections", required_argument, NULL, 'c' },
     { "duration",    required_argument, NULL, 'd' },
     { "threads",     required_argument, NULL, 't' },
+    { "rate",        required_argument, NULL, 'R' },
     { "script",      required_argument, NULL, 's' },
     { "header",      required_argument, NULL, 'H' },
     { "latency",     no_argument,       NULL, 'L' },
+    { "percentiles", required_argument, NULL, 'P' },
+    { "latency-spectrum", no_argument,  NULL, 'S' },
+    { "latency-log", required_argument, NULL, 'G' },
+    { "merge",       no_argument,       NULL, 'M' },
+    { "json",        required_argument, NULL, 'J' },
     { "timeout",     required_argument, NULL, 'T' },
+    { "interval",    required_argument, NULL, 'I' },
+    { "engine",      required_argument, NULL, 'E' },
+    { "recv-buffer", required_argument, NULL, 'B' },
+    { "source-ips",  required_argument, NULL, 'A' },
+    { "requests-per-connection", required_argument, NULL, 'N' },
+    { "tls-handshakes", required_argument, NULL, 'K' },
+    { "ktls",        no_argument,       NULL, 'k' },
+    { "tls-version", required_argument, NULL, 'V' },
+    { "tls-ciphers", required_argument, NULL, 'C' },
+    { "tls-groups",  required_argument, NULL, 'Y' },
+    { "alpn",        required_argument, NULL, 'W' },
+    { "http2",       no_argument,       NULL, '2' },
+    { "streams",     required_argument, NULL, 'Q' },
     { "help",        no_argument,       NULL, 'h' },
     { "version",     no_argument,       NULL, 'v' },
     { NULL,          0,                 NULL,  0  }
@@ -529,8 +1239,11 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
     cfg->connections = 10;
     cfg->duration    = 10;
     cfg->timeout     = SOCKET_TIMEOUT_MS;
+    cfg->recvbuf     = RECVBUF;
+    cfg->ssl.resume  = true;
+    cfg->streams     = 1;
 
-    while ((c = getopt_long(argc, argv, "t:c:d:s:H:T:Lrv?", longopts, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "t:c:d:s:H:T:R:Lrv?", longopts, NULL)) != -1) {
         switch (c) {
             case 't':
                 if (scan_metric(optarg, &cfg->threads)) return -1;
@@ -541,6 +1254,9 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 'd':
                 if (scan_time(optarg, &cfg->duration)) return -1;
                 break;
+            case 'R':
+                if (scan_metric(optarg, &cfg->rate)) return -1;
+                break;
             case 's':
                 cfg->script = optarg;
                 break;
@@ -550,10 +1266,91 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
             case 'L':
                 cfg->latency = true;
                 break;
+            case 'P':
+                if (parse_percentiles(cfg, optarg)) return -1;
+                cfg->latency = true;
+                break;
+            case 'S':
+                cfg->spectrum = true;
+                break;
+            case 'G':
+                if (!(cfg->hlog = fopen(optarg, "w"))) {
+                    fprintf(stderr, "unable to open %s: %s\n", optarg, strerror(errno));
+                    return -1;
+                }
+                break;
+            case 'M':
+                cfg->merge = true;
+                break;
+            case 'J':
+                if (!strcmp(optarg, "-")) {
+                    cfg->json = fdopen(dup(STDOUT_FILENO), "w");
+                    dup2(STDERR_FILENO, STDOUT_FILENO);
+                } else if (!(cfg->json = fopen(optarg, "w"))) {
+                    fprintf(stderr, "unable to open %s: %s\n", optarg, strerror(errno));
+                    return -1;
+                }
+                break;
             case 'T':
                 if (scan_time(optarg, &cfg->timeout)) return -1;
                 cfg->timeout *= 1000;
                 break;
+            case 'I':
+                if (scan_time(optarg, &cfg->interval)) return -1;
+                break;
+            case 'B':
+                if (scan_metric(optarg, &cfg->recvbuf)) return -1;
+                if (!cfg->recvbuf || cfg->recvbuf > INT_MAX) return -1;
+                break;
+            case 'N':
+                if (scan_metric(optarg, &cfg->reuse)) return -1;
+                break;
+            case 'A':
+                if (parse_sources(cfg, optarg)) return -1;
+                break;
+            case 'K':
+                if (!strcmp(optarg, "full")) {
+                    cfg->ssl.resume = false;
+                } else if (strcmp(optarg, "resumed")) {
+                    fprintf(stderr, "invalid --tls-handshakes: %s\n", optarg);
+                    return -1;
+                }
+                cfg->handshakes = true;
+                break;
+            case 'k':
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+                cfg->ssl.ktls = true;
+                break;
+#else
+                fprintf(stderr, "kTLS is not supported by this OpenSSL\n");
+                return -1;
+#endif
+            case 'V':
+                if (parse_tls_version(cfg, optarg)) return -1;
+                break;
+            case 'C':
+                cfg->ssl.ciphers = optarg;
+                break;
+            case 'Y':
+                cfg->ssl.groups = optarg;
+                break;
+            case 'W':
+                cfg->ssl.alpn = optarg;
+                break;
+            case 'Q':
+                if (scan_metric(optarg, &cfg->streams)) return -1;
+                if (!cfg->streams || cfg->streams > UINT32_MAX) return -1;
+                cfg->http2 = true;
+                break;
+            case '2':
+                cfg->http2 = true;
+                break;
+            case 'E':
+                if (aeSetApi(optarg) != AE_OK) {
+                    fprintf(stderr, "unsupported engine: %s\n", optarg);
+                    return -1;
+                }
+                break;
             case 'v':
                 printf("wrk %s [%s] ", VERSION, aeGetApiName());
                 printf("Copyright (C) 2012 Will Glozer\n");
@@ -568,12 +1365,30 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
 
     if (optind == argc || !cfg->threads || !cfg->duration) return -1;
 
+    if (!cfg->percentiles && parse_percentiles(cfg, "50,75,90,99")) return -1;
+
+    if (cfg->merge) return 0;
+
     // don't free the space by wrk
     // make up scheme
-    size_t url_len = strlen(argv[optind]) + 8;
+    size_t url_len = strlen(argv[optind]) + 18;
     char *complete_url = zmalloc(sizeof(char) * url_len);
     memset(complete_url, 0, url_len);
-    if (strncmp(argv[optind], "http://", 7) && strncmp(argv[optind], "https://", 8)) {
+    if (!strncmp(argv[optind], "unix://", 7)) {
+        // unix:///run/app.sock:/path is requested as http://localhost/path
+        char *path = argv[optind] + 7;
+        char *sep  = strchr(path, ':');
+        char *req  = sep && sep[1] ? sep + 1 : "/";
+        size_t len = sep ? (size_t) (sep - path) : strlen(path);
+        if (!len || *req != '/') {
+            fprintf(stderr, "invalid URL: %s\n", argv[optind]);
+            return -1;
+        }
+        cfg->unix = zcalloc(len + 1);
+        memcpy(cfg->unix, path, len);
+        strcpy(complete_url, "http://localhost");
+        strcat(complete_url, req);
+    } else if (strncmp(argv[optind], "http://", 7) && strncmp(argv[optind], "https://", 8)) {
         memcpy(complete_url, "http://", 7);
         memcpy(complete_url + 7, argv[optind], strlen(argv[optind]));
     } else {
@@ -596,6 +1411,171 @@ static int parse_args(struct config *cfg, char **url, struct http_parser_url *pa
     return 0;
 }
 
+static int parse_tls_version(struct config *cfg, char *s) {
+    static const struct {
+        char *name;
+        int version;
+    } versions[] = {
+        { "1.0", TLS1_VERSION   },
+        { "1.1", TLS1_1_VERSION },
+        { "1.2", TLS1_2_VERSION },
+        { "1.3", TLS1_3_VERSION },
+    };
+
+    for (size_t i = 0; i < sizeof(versions) / sizeof(versions[0]); i++) {
+        if (!strcmp(s, versions[i].name)) {
+            cfg->ssl.version = versions[i].version;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "unsupported TLS version: %s\n", s);
+    return -1;
+}
+
+static int parse_address(char *s, source *src) {
+    if (inet_pton(AF_INET, s, src->addr) == 1) {
+        src->family = AF_INET;
+        return 0;
+    }
+    if (inet_pton(AF_INET6, s, src->addr) == 1) {
+        src->family = AF_INET6;
+        return 0;
+    }
+    return -1;
+}
+
+// the last 32 bits of an address, which is all a range may span
+static uint32_t address_tail(source *src) {
+    uint8_t *p = src->addr + (src->family == AF_INET ? 0 : 12);
+    return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void address_set_tail(source *src, uint32_t tail) {
+    uint8_t *p = src->addr + (src->family == AF_INET ? 0 : 12);
+    p[0] = tail >> 24;
+    p[1] = tail >> 16;
+    p[2] = tail >> 8;
+    p[3] = tail;
+}
+
+// parse a comma separated list of addresses, first-last ranges and
+// CIDR blocks into the ranges of source addresses to bind to
+static int parse_sources(struct config *cfg, char *list) {
+    size_t count = 1;
+    for (char *c = list; *c; c++) {
+        if (*c == ',') count++;
+    }
+
+    source *sources = zcalloc(count * sizeof(source));
+    char *copy = zstrdup(list), *save = NULL, *item;
+    size_t n = 0;
+    uint64_t total = 0;
+
+    for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        source *src = &sources[n++];
+        char *dash = strchr(item, '-');
+        char *slash = strchr(item, '/');
+
+        if (dash) *dash = '\0';
+        if (slash) *slash = '\0';
+        if (parse_address(item, src)) goto error;
+        src->count = 1;
+
+        if (dash) {
+            source last;
+            if (parse_address(dash + 1, &last) || last.family != src->family) goto error;
+            if (memcmp(src->addr, last.addr, src->family == AF_INET ? 0 : 12)) goto error;
+            if (address_tail(&last) < address_tail(src)) goto error;
+            src->count = (uint64_t) address_tail(&last) - address_tail(src) + 1;
+        } else if (slash) {
+            int bits = src->family == AF_INET ? 32 : 128;
+            char *end;
+            long prefix = strtol(slash + 1, &end, 10);
+            if (end == slash + 1 || *end || prefix < bits - 32 || prefix > bits) goto error;
+            src->count = (uint64_t) 1 << (bits - prefix);
+            uint32_t mask = prefix == bits - 32 ? 0 : ~0U << (bits - prefix);
+            address_set_tail(src, address_tail(src) & mask);
+        }
+
+        total += src->count;
+    }
+
+    if (!n) goto error;
+
+    zfree(copy);
+    zfree(cfg->sources);
+    cfg->sources  = sources;
+    cfg->nsources = n;
+    cfg->naddrs   = total;
+    return 0;
+
+  error:
+    fprintf(stderr, "invalid source address list: %s\n", list);
+    zfree(copy);
+    zfree(sources);
+    return -1;
+}
+
+// bind fd to the next source address of the thread's round-robin, the
+// port is left for connect() to pick so every address can reuse the
+// whole ephemeral port range towards the same destination
+static int bind_source(thread *thread, int fd) {
+    uint64_t index = thread->source++ % cfg.naddrs;
+    source *src = cfg.sources, addr;
+    struct sockaddr_storage ss;
+    socklen_t len;
+
+    while (index >= src->count) index -= src++->count;
+    addr = *src;
+    address_set_tail(&addr, address_tail(src) + (uint32_t) index);
+
+    memset(&ss, 0, sizeof(ss));
+    if (addr.family == AF_INET) {
+        struct sockaddr_in *sin = (struct sockaddr_in *) &ss;
+        sin->sin_family = AF_INET;
+        memcpy(&sin->sin_addr, addr.addr, 4);
+        len = sizeof(*sin);
+    } else {
+        struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &ss;
+        sin6->sin6_family = AF_INET6;
+        memcpy(&sin6->sin6_addr, addr.addr, 16);
+        len = sizeof(*sin6);
+    }
+
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    int flag = 1;
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &flag, sizeof(flag));
+#endif
+
+    return bind(fd, (struct sockaddr *) &ss, len);
+}
+
+static int parse_percentiles(struct config *cfg, char *list) {
+    size_t count = 1;
+    for (char *c = list; *c; c++) {
+        if (*c == ',') count++;
+    }
+
+    long double *percentiles = zcalloc(count * sizeof(long double));
+    char *s = list, *end;
+
+    for (size_t i = 0; i < count; i++) {
+        percentiles[i] = strtold(s, &end);
+        if (end == s || (*end && *end != ',') || percentiles[i] <= 0 || percentiles[i] > 100) {
+            fprintf(stderr, "invalid percentile list: %s\n", list);
+            zfree(percentiles);
+            return -1;
+        }
+        s = end + 1;
+    }
+
+    zfree(cfg->percentiles);
+    cfg->percentiles  = percentiles;
+    cfg->npercentiles = count;
+    return 0;
+}
+
 static void print_stats_header() {
     printf("  Thread Stats%6s%11s%8s%12s\n", "Avg", "Stdev", "Max", "+/- Stdev");
 }
@@ -625,14 +1605,225 @@ static void print_stats(char *name, stats *stats, char *(*fmt)(long double)) {
     printf("%8.2Lf%%\n", stats_within_stdev(stats, mean, stdev, 1));
 }
 
+static yyjson_mut_val *json_stats(yyjson_mut_doc *doc, stats *stats, bool percentiles) {
+    yyjson_mut_val *obj = yyjson_mut_obj(doc);
+    long double mean  = stats_mean(stats);
+    long double stdev = stats_stdev(stats, mean);
+
+    yyjson_mut_obj_add_uint(doc, obj, "min",   stats->count ? stats->min : 0);
+    yyjson_mut_obj_add_uint(doc, obj, "max",   stats->max);
+    yyjson_mut_obj_add_real(doc, obj, "mean",  mean);
+    yyjson_mut_obj_add_real(doc, obj, "stdev", stdev);
+    yyjson_mut_obj_add_real(doc, obj, "within_stdev",
+                            stats->count ? stats_within_stdev(stats, mean, stdev, 1) : 0);
+    yyjson_mut_obj_add_uint(doc, obj, "count", stats->count);
+
+    if (percentiles) {
+        uint64_t *values = zcalloc(cfg.npercentiles * sizeof(uint64_t));
+        yyjson_mut_val *arr = yyjson_mut_arr(doc);
+
+        stats_percentiles(stats, cfg.percentiles, values, cfg.npercentiles);
+        for (size_t i = 0; i < cfg.npercentiles; i++) {
+            yyjson_mut_val *p = yyjson_mut_obj(doc);
+            yyjson_mut_obj_add_real(doc, p, "percentile", cfg.percentiles[i]);
+            yyjson_mut_obj_add_uint(doc, p, "value", values[i]);
+            yyjson_mut_arr_append(arr, p);
+        }
+        yyjson_mut_obj_add(obj, yyjson_mut_str(doc, "percentiles"), arr);
+
+        zfree(values);
+    }
+
+    return obj;
+}
+
+static void print_json(char *url, uint64_t runtime_us, uint64_t complete, uint64_t bytes, uint64_t connects, errors *errors) {
+    yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+    yyjson_mut_val *root = yyjson_mut_obj(doc);
+    yyjson_mut_val *config = yyjson_mut_obj(doc);
+    yyjson_mut_val *errs = yyjson_mut_obj(doc);
+    long double runtime_s = runtime_us / 1000000.0;
+
+    yyjson_mut_obj_add_str(doc, config, "url", url);
+    yyjson_mut_obj_add_uint(doc, config, "threads", cfg.threads);
+    yyjson_mut_obj_add_uint(doc, config, "connections", cfg.connections);
+    yyjson_mut_obj_add_uint(doc, config, "duration", cfg.duration);
+    yyjson_mut_obj_add_uint(doc, config, "timeout", cfg.timeout);
+    yyjson_mut_obj_add_uint(doc, config, "rate", cfg.rate);
+    yyjson_mut_obj_add_uint(doc, config, "pipeline", cfg.pipeline);
+    if (cfg.http2) yyjson_mut_obj_add_uint(doc, config, "streams", cfg.streams);
+    yyjson_mut_obj_add_uint(doc, config, "requests_per_connection", cfg.reuse);
+    if (cfg.ssl.ciphers) yyjson_mut_obj_add_str(doc, config, "tls_ciphers", cfg.ssl.ciphers);
+    if (cfg.ssl.groups)  yyjson_mut_obj_add_str(doc, config, "tls_groups", cfg.ssl.groups);
+    if (cfg.ssl.alpn)    yyjson_mut_obj_add_str(doc, config, "alpn", cfg.ssl.alpn);
+    if (cfg.handshakes) {
+        char *mode = cfg.ssl.resume ? "resumed" : "full";
+        yyjson_mut_obj_add_str(doc, config, "tls_handshakes", mode);
+    }
+    if (cfg.script) yyjson_mut_obj_add_str(doc, config, "script", cfg.script);
+
+    yyjson_mut_obj_add_uint(doc, errs, "connect", errors->connect);
+    yyjson_mut_obj_add_uint(doc, errs, "read",    errors->read);
+    yyjson_mut_obj_add_uint(doc, errs, "write",   errors->write);
+    yyjson_mut_obj_add_uint(doc, errs, "status",  errors->status);
+    yyjson_mut_obj_add_uint(doc, errs, "timeout", errors->timeout);
+
+    yyjson_mut_obj_add_str(doc, root, "version", VERSION);
+    yyjson_mut_obj_add(root, yyjson_mut_str(doc, "config"), config);
+    yyjson_mut_obj_add_uint(doc, root, "duration", runtime_us);
+    yyjson_mut_obj_add_uint(doc, root, "requests", complete);
+    yyjson_mut_obj_add_uint(doc, root, "bytes", bytes);
+    yyjson_mut_obj_add_real(doc, root, "requests_per_sec", complete / runtime_s);
+    yyjson_mut_obj_add_real(doc, root, "bytes_per_sec", bytes / runtime_s);
+    if (statistics.memory) {
+        yyjson_mut_obj_add_uint(doc, root, "memory_per_connection", statistics.memory);
+    }
+    yyjson_mut_obj_add_uint(doc, root, "connects", connects);
+    yyjson_mut_obj_add_real(doc, root, "connects_per_sec", connects / runtime_s);
+    if (cfg.tls) {
+        yyjson_mut_val *tls = yyjson_mut_obj(doc);
+        uint64_t full = statistics.handshakes - statistics.resumed;
+        yyjson_mut_obj_add_uint(doc, tls, "full", full);
+        yyjson_mut_obj_add_uint(doc, tls, "resumed", statistics.resumed);
+        yyjson_mut_obj_add_real(doc, tls, "full_per_sec", full / runtime_s);
+        yyjson_mut_obj_add_real(doc, tls, "resumed_per_sec", statistics.resumed / runtime_s);
+        if (cfg.ssl.ktls) {
+            yyjson_mut_obj_add_uint(doc, tls, "ktls_recv", statistics.ktls_recv);
+            yyjson_mut_obj_add_uint(doc, tls, "ktls_send", statistics.ktls_send);
+        }
+        yyjson_mut_obj_add(root, yyjson_mut_str(doc, "handshakes"), tls);
+        if (statistics.tls) yyjson_mut_obj_add_str(doc, root, "tls", statistics.tls);
+    }
+    yyjson_mut_obj_add(root, yyjson_mut_str(doc, "errors"), errs);
+    yyjson_mut_obj_add(root, yyjson_mut_str(doc, "latency"),
+                       json_stats(doc, statistics.latency, true));
+    yyjson_mut_obj_add(root, yyjson_mut_str(doc, "req_per_sec"),
+                       json_stats(doc, statistics.requests, false));
+    if (cfg.rate) {
+        yyjson_mut_obj_add(root, yyjson_mut_str(doc, "send_lag"),
+                           json_stats(doc, statistics.lag, true));
+    }
+
+    yyjson_mut_val *codes = yyjson_mut_obj(doc);
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (!statistics.status[i]) continue;
+        char code[4];
+        snprintf(code, sizeof(code), "%d", STATUS_MIN + i);
+        yyjson_mut_obj_add(codes, yyjson_mut_strcpy(doc, code),
+                           yyjson_mut_uint(doc, statistics.status[i]));
+    }
+    yyjson_mut_obj_add(root, yyjson_mut_str(doc, "status"), codes);
+
+    if (cfg.latency) {
+        yyjson_mut_val *obj = yyjson_mut_obj(doc);
+        for (int i = 0; i < STATUS_CLASSES; i++) {
+            if (!statistics.classes[i]->count) continue;
+            char name[4];
+            snprintf(name, sizeof(name), "%dxx", i + 1);
+            yyjson_mut_obj_add(obj, yyjson_mut_strcpy(doc, name),
+                               json_stats(doc, statistics.classes[i], true));
+        }
+        yyjson_mut_obj_add(root, yyjson_mut_str(doc, "status_latency"), obj);
+    }
+
+    if (cfg.phases) {
+        phases *phases = &statistics.phases;
+        yyjson_mut_val *obj = yyjson_mut_obj(doc);
+        yyjson_mut_obj_add(obj, yyjson_mut_str(doc, "connect"),
+                           json_stats(doc, phases->connect, true));
+        yyjson_mut_obj_add(obj, yyjson_mut_str(doc, "handshake"),
+                           json_stats(doc, phases->handshake, true));
+        yyjson_mut_obj_add(obj, yyjson_mut_str(doc, "ttfb"),
+                           json_stats(doc, phases->ttfb, true));
+        yyjson_mut_obj_add(obj, yyjson_mut_str(doc, "transfer"),
+                           json_stats(doc, phases->transfer, true));
+        yyjson_mut_obj_add(root, yyjson_mut_str(doc, "phases"), obj);
+    }
+
+    yyjson_mut_doc_set_root(doc, root);
+    char *json = yyjson_mut_write(doc, YYJSON_WRITE_PRETTY, NULL);
+    if (json) {
+        fprintf(cfg.json, "%s\n", json);
+        free(json);
+    }
+    fclose(cfg.json);
+    yyjson_mut_doc_free(doc);
+}
+
+static void print_interval_header() {
+    printf("  Interval%11s%9s %8s%10s%10s%10s%10s\n",
+           "Requests", "Req/Sec", "Errors", "50%", "90%", "99%", "Max");
+}
+
+static void print_interval(uint64_t elapsed, uint64_t length, uint64_t complete, errors *errors, stats *stats) {
+    long double req_per_s = complete / (length / 1000000.0);
+    uint64_t failed = errors->connect + errors->read + errors->write
+                    + errors->timeout + errors->status;
+
+    printf("  %7"PRIu64"s", elapsed / 1000000);
+    printf("%11"PRIu64, complete);
+    print_units(req_per_s, format_metric, 10);
+    printf("%8"PRIu64, failed);
+    print_units(stats_percentile(stats, 50.0), format_time_us, 10);
+    print_units(stats_percentile(stats, 90.0), format_time_us, 10);
+    print_units(stats_percentile(stats, 99.0), format_time_us, 10);
+    print_units(stats->max, format_time_us, 10);
+    printf("\n");
+    fflush(stdout);
+}
+
+static void print_stats_phases(phases *phases) {
+    if (phases->connect->count)   print_stats("Connect",  phases->connect,   format_time_us);
+    if (phases->handshake->count) print_stats("TLS",      phases->handshake, format_time_us);
+    if (phases->ttfb->count)      print_stats("TTFB",     phases->ttfb,      format_time_us);
+    if (phases->transfer->count)  print_stats("Transfer", phases->transfer,  format_time_us);
+}
+
+static void print_stats_classes(stats **classes) {
+    for (int i = 0; i < STATUS_CLASSES; i++) {
+        if (!classes[i]->count) continue;
+        char name[16];
+        snprintf(name, sizeof(name), "%dxx", i + 1);
+        print_stats(name, classes[i], format_time_us);
+    }
+}
+
+static void print_status(uint64_t *status) {
+    char *sep = "  Status codes: ";
+    for (int i = 0; i < STATUS_CODES; i++) {
+        if (!status[i]) continue;
+        printf("%s%d %"PRIu64, sep, STATUS_MIN + i, status[i]);
+        sep = ", ";
+    }
+    if (*sep == ',') printf("\n");
+}
+
 static void print_stats_latency(stats *stats) {
-    long double percentiles[] = { 50.0, 75.0, 90.0, 99.0 };
+    uint64_t *values = zcalloc(cfg.npercentiles * sizeof(uint64_t));
+    stats_percentiles(stats, cfg.percentiles, values, cfg.npercentiles);
     printf("  Latency Distribution\n");
-    for (size_t i = 0; i < sizeof(percentiles) / sizeof(long double); i++) {
-        long double p = percentiles[i];
-        uint64_t n = stats_percentile(stats, p);
-        printf("%7.0Lf%%", p);
-        print_units(n, format_time_us, 10);
+    for (size_t i = 0; i < cfg.npercentiles; i++) {
+        printf("%7.8Lg%%", cfg.percentiles[i]);
+        print_units(values[i], format_time_us, 10);
         printf("\n");
     }
+    zfree(values);
+}
+
+static void print_spectrum_point(uint64_t value, long double p, uint64_t total, void *data) {
+    printf("%12.3Lf %2.12Lf %10"PRIu64, value / 1000.0L, p / 100.0, total);
+    if (p < 100.0) printf(" %14.2Lf", 1.0 / (1.0 - p / 100.0));
+    printf("\n");
+}
+
+static void print_stats_spectrum(stats *stats) {
+    long double mean  = stats_mean(stats);
+    long double stdev = stats_stdev(stats, mean);
+
+    printf("  Latency Spectrum (ms)\n");
+    printf("%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    stats_spectrum(stats, SPECTRUM_TICKS, print_spectrum_point, NULL);
+    printf("#[Mean    = %12.3Lf, StdDeviation   = %12.3Lf]\n", mean / 1000.0, stdev / 1000.0);
+    printf("#[Max     = %12.3Lf, Total count    = %12"PRIu64"]\n", stats->max / 1000.0L, stats->count);
+    printf("#[Buckets = %12d, SubBuckets     = %12d]\n", stats->buckets, stats->half * 2);
 }
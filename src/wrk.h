@@ -15,6 +15,7 @@
 #include "stats.h"
 #include "ae.h"
 #include "http_parser.h"
+#include "http2.h"
 #include "md5.h"
 #include "yyjson.h"
 
@@ -23,9 +24,36 @@
 #define MAX_THREAD_RATE_S   10000000
 #define SOCKET_TIMEOUT_MS   2000
 #define RECORD_INTERVAL_MS  100
+#define STATS_DIGITS        3
+#define SPECTRUM_TICKS      5
+#define STATUS_MIN          100
+#define STATUS_CODES        500
+#define STATUS_CLASSES      5
 
 extern const char *VERSION;
 
+typedef struct {
+    uint64_t epoch;
+    uint64_t taken;
+    uint64_t complete;
+    uint64_t bytes;
+    errors errors;
+    stats *latency;
+} snapshot;
+
+typedef struct {
+    int family;
+    uint8_t addr[16];
+    uint64_t count;
+} source;
+
+typedef struct {
+    stats *connect;
+    stats *handshake;
+    stats *ttfb;
+    stats *transfer;
+} phases;
+
 typedef struct {
     pthread_t thread;
     aeEventLoop *loop;
@@ -34,10 +62,34 @@ typedef struct {
     uint64_t complete;
     uint64_t requests;
     uint64_t bytes;
+    uint64_t connects;
+    uint64_t handshakes;
+    uint64_t resumed;
+    uint64_t ktls_recv;
+    uint64_t ktls_send;
     uint64_t start;
+    uint64_t interval;
+    uint64_t source;
+    bool uring;
     lua_State *L;
+    SSL_CTX *ctx;
+    char *tls;
     errors errors;
+    stats *latency;
+    stats *rates;
+    stats *lag;
+    stats *window;
+    phases phases;
+    uint64_t status[STATUS_CODES];
+    stats *classes[STATUS_CLASSES];
+    snapshot report;
+    snapshot last;
     struct connection *cs;
+    struct connection_cold *cold;
+    http2 *h2;
+    http2_stream *streams;
+    http2_request request;
+    char *buf;
 } thread;
 
 typedef struct {
@@ -46,23 +98,39 @@ typedef struct {
     char  *cursor;
 } buffer;
 
+// state touched on every request, kept small so that a thread's
+// connections are packed into as few cache lines as possible
 typedef struct connection {
     thread *thread;
     http_parser parser;
-    enum {
-        FIELD, VALUE
-    } state;
     int fd;
-    SSL *ssl;
     bool delayed;
-    uint64_t start;
+    bool ktls;
+    uint16_t generation;
+    SSL *ssl;
     char *request;
     size_t length;
     size_t written;
     uint64_t pending;
+    uint64_t responses;
+    uint64_t start;
+    uint64_t next;
+    uint64_t connected;
+    uint64_t deadline;
+} connection;
+
+// state only needed with --latency or a response() script, stored in
+// a side table at the same index as the connection
+typedef struct connection_cold {
+    enum {
+        FIELD, VALUE
+    } state;
+    bool ticket;
+    long long ticket_timer;
+    uint64_t connecting;
+    uint64_t first;
     buffer headers;
     buffer body;
-    char buf[RECVBUF];
-} connection;
+} connection_cold;
 
 #endif /* WRK_H */
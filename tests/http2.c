@@ -0,0 +1,204 @@
+// frame and HPACK tests for the HTTP/2 engine, run with make test
+
+#include <stdio.h>
+#include <string.h>
+
+#include "http2.h"
+#include "zmalloc.h"
+
+#define PREFACE_LEN 24
+
+static int failed;
+
+#define check(expr) do {                                          \
+    if (!(expr)) {                                                \
+        fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #expr); \
+        failed++;                                                 \
+    }                                                             \
+} while (0)
+
+typedef struct {
+    uint32_t status;
+    uint32_t finished;
+    uint32_t reset;
+} result;
+
+static void finished(void *data, http2_stream *s, bool reset) {
+    result *r = data;
+    r->status = s->status;
+    r->finished++;
+    r->reset += reset;
+}
+
+static size_t frame(uint8_t *buf, uint8_t type, uint8_t flags, uint32_t id, void *payload, uint32_t len) {
+    uint8_t head[9] = {
+        len >> 16, len >> 8, len, type, flags,
+        id >> 24, id >> 16, id >> 8, id
+    };
+    memcpy(buf, head, sizeof(head));
+    memcpy(buf + sizeof(head), payload, len);
+    return sizeof(head) + len;
+}
+
+static size_t setting(uint8_t *buf, uint16_t id, uint32_t value) {
+    uint8_t s[6] = { id >> 8, id, value >> 24, value >> 16, value >> 8, value };
+    return frame(buf, 0x4, 0, 0, s, sizeof(s));
+}
+
+static void test_encode(void) {
+    char get[] = "GET / HTTP/1.1\r\nHost: example\r\nConnection: keep-alive\r\nX-A: b\r\n\r\n";
+    char post[] = "POST /p HTTP/1.1\r\nContent-Length: 2\r\n\r\nhi";
+    uint8_t block[] = {
+        0x82, 0x86, 0x84, 0x01, 0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+        0x00, 0x03, 'x', '-', 'a', 0x01, 'b'
+    };
+    http2_request r;
+
+    check(http2_request_encode(&r, get, strlen(get), "host", false));
+    check(r.blen == sizeof(block) && !memcmp(r.block, block, sizeof(block)));
+    check(r.bodylen == 0);
+    http2_request_free(&r);
+
+    check(http2_request_encode(&r, post, strlen(post), "host", true));
+    check(r.blen > 4 && r.block[0] == 0x83 && r.block[1] == 0x87);
+    check(r.block[2] == 0x04 && r.block[3] == 0x02 && !memcmp(r.block + 4, "/p", 2));
+    check(r.bodylen == 2 && !memcmp(r.body, "hi", 2));
+    http2_request_free(&r);
+
+    check(!http2_request_encode(&r, "GET /", 5, "host", false));
+}
+
+// open stream 1 and answer it with a HEADERS frame carrying block
+static uint32_t status(uint8_t *block, uint32_t len) {
+    http2_stream slots[1];
+    http2_request req;
+    http2 h = { 0 };
+    result res = { 0 };
+    uint8_t buf[64];
+    char get[] = "GET / HTTP/1.1\r\n\r\n";
+
+    http2_init(&h, slots, 1);
+    http2_request_encode(&req, get, strlen(get), "host", false);
+    check(http2_submit(&h, &req, 1));
+    size_t n = frame(buf, 0x1, 0x5, 1, block, len);
+    check(http2_parse(&h, buf, n, 2, finished, &res));
+    check(res.finished == 1 && !res.reset && h.active == 0);
+    http2_request_free(&req);
+    zfree(h.out);
+    return res.status;
+}
+
+static void test_status(void) {
+    check(status((uint8_t[]) { 0x88 }, 1) == 200);
+    check(status((uint8_t[]) { 0x8d }, 1) == 404);
+    check(status((uint8_t[]) { 0x20, 0x8e }, 2) == 500);
+    check(status((uint8_t[]) { 0x08, 0x03, '5', '0', '3' }, 5) == 503);
+    check(status((uint8_t[]) { 0x48, 0x03, '3', '0', '1' }, 5) == 301);
+    check(status((uint8_t[]) { 0x08, 0x82, 0x10, 0x01 }, 4) == 200);
+    check(status((uint8_t[]) { 0x08, 0x83, 0x6c, 0x0c, 0xff }, 5) == 503);
+    check(status((uint8_t[]) { 0x01, 0x01, 'x' }, 3) == 0);
+}
+
+static void test_frames(void) {
+    http2_stream slots[2];
+    http2_request req;
+    http2 h = { 0 };
+    result res = { 0 };
+    uint8_t buf[256];
+    char get[] = "GET / HTTP/1.1\r\n\r\n";
+    size_t n;
+
+    http2_init(&h, slots, 2);
+    check(h.outlen > PREFACE_LEN && !memcmp(h.out, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", PREFACE_LEN));
+    http2_sent(&h, h.outlen);
+    check(h.outlen == 0);
+
+    // SETTINGS are acknowledged and replace the assumed stream limit
+    n = setting(buf, 0x3, 1);
+    check(http2_parse(&h, buf, n, 0, finished, &res));
+    check(h.limit == 1 && h.outlen == 9 && h.out[3] == 0x4 && h.out[4] == 0x1);
+    http2_sent(&h, h.outlen);
+
+    http2_request_encode(&req, get, strlen(get), "host", false);
+    check(http2_submit(&h, &req, 1));
+    check(!http2_can_submit(&h) && !http2_submit(&h, &req, 1));
+
+    // frames split across reads, the response ends on DATA
+    n  = frame(buf, 0x1, 0x4, 1, (uint8_t[]) { 0x8d }, 1);
+    n += frame(buf + n, 0x0, 0x1, 1, "not found", 9);
+    for (size_t i = 0; i < n; i++) {
+        check(http2_parse(&h, buf + i, 1, 2, finished, &res));
+    }
+    check(res.finished == 1 && res.status == 404 && h.active == 0);
+
+    // a PING is answered with the same payload
+    http2_sent(&h, h.outlen);
+    n = frame(buf, 0x6, 0, 0, "12345678", 8);
+    check(http2_parse(&h, buf, n, 3, finished, &res));
+    check(h.outlen == 17 && h.out[4] == 0x1 && !memcmp(h.out + 9, "12345678", 8));
+
+    check(http2_submit(&h, &req, 4));
+    n = frame(buf, 0x3, 0, 3, (uint8_t[]) { 0, 0, 0, 8 }, 4);
+    check(http2_parse(&h, buf, n, 5, finished, &res));
+    check(res.finished == 2 && res.reset == 1 && h.active == 0);
+
+    // GOAWAY stops new streams
+    n = frame(buf, 0x7, 0, 0, (uint8_t[]) { 0, 0, 0, 3, 0, 0, 0, 0 }, 8);
+    check(http2_parse(&h, buf, n, 6, finished, &res));
+    check(h.goaway && !http2_can_submit(&h));
+
+    http2_request_free(&req);
+    zfree(h.out);
+}
+
+static void test_settings(void) {
+    struct { uint16_t id; uint32_t value; bool valid; } cases[] = {
+        { 0x4, 0x7fffffff, true  },
+        { 0x4, 0x80000000, false },
+        { 0x5, 16384,      true  },
+        { 0x5, 16777215,   true  },
+        { 0x5, 0,          false },
+        { 0x5, 16383,      false },
+        { 0x5, 16777216,   false },
+    };
+    http2_stream slots[1];
+    uint8_t buf[32];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        http2 h = { 0 };
+        result res = { 0 };
+        http2_init(&h, slots, 1);
+        size_t n = setting(buf, cases[i].id, cases[i].value);
+        if (http2_parse(&h, buf, n, 0, finished, &res) != cases[i].valid) {
+            fprintf(stderr, "SETTINGS %u=%u\n", cases[i].id, cases[i].value);
+            failed++;
+        }
+        zfree(h.out);
+    }
+
+    // a body larger than the server's stream window is refused
+    http2 h = { 0 };
+    http2_request req;
+    char post[] = "POST / HTTP/1.1\r\n\r\n0123456789";
+    http2_init(&h, slots, 1);
+    size_t n = setting(buf, 0x4, 8);
+    check(http2_parse(&h, buf, n, 0, finished, NULL));
+    check(http2_request_encode(&req, post, strlen(post), "host", false));
+    check(http2_can_submit(&h) && !http2_submit(&h, &req, 1));
+    http2_request_free(&req);
+    zfree(h.out);
+}
+
+int main(int argc, char **argv) {
+    test_encode();
+    test_status();
+    test_frames();
+    test_settings();
+
+    if (failed) {
+        fprintf(stderr, "%d checks failed\n", failed);
+        return 1;
+    }
+    printf("http2: ok\n");
+    return 0;
+}